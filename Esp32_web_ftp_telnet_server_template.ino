@@ -51,6 +51,9 @@
 #define DEFAULT_NTP_SERVER_2          "2.si.pool.ntp.org"
 #define DEFAULT_NTP_SERVER_3          "3.si.pool.ntp.org"
 #include "./servers/time_functions.h"     
+#if __has_include ("embedded_html.h")
+  #include "embedded_html.h"                                    // files from html/ directory built into the firmware by embed_html.py, web server sends them straight from flash
+#endif
 #include "./servers/webServer.hpp"                              // include HTTP Server
 #include "./servers/ftpServer.hpp"                              // include FTP server
 #include "./servers/telnetServer.hpp"                           // include Telnet server
@@ -80,11 +83,6 @@ String httpRequestHandler (String& httpRequest, httpServer::wwwSessionParameters
 
               httpRequestCount.increaseCounter ();                            // gether some statistics
 
-              // variables used by example 05
-              static String niceSwitch1 = "false";  
-              static int niceSlider3 = 3;
-              static String niceRadio5 = "fm";
-
               // ----- handle HTTP protocol requests -----
               
                    if (httpRequest.substring (0, 20) == "GET /example01.html ")       { // used by example 01
@@ -102,63 +100,11 @@ String httpRequestHandler (String& httpRequest, httpServer::wwwSessionParameters
                                                                                         digitalWrite (2, LOW);
                                                                                         goto getBuiltInLed;
                                                                                       }
-              else if (httpRequest.substring (0, 12) == "GET /upTime ")               { // used by index.html
-                                                                                        time_t t = getUptime ();       // t holds seconds
-                                                                                        int seconds = t % 60; t /= 60; // t now holds minutes
-                                                                                        int minutes = t % 60; t /= 60; // t now holds hours
-                                                                                        int hours = t % 24;   t /= 24; // t now holds days
-                                                                                        char c [10];
-                                                                                        sprintf (c, "%02i:%02i:%02i", hours, minutes, seconds);
-                                                                                        String s = "";
-                                                                                        if (t) s += String ((unsigned long) t) + " days, ";
-                                                                                        s += String (c);
-                                                                                        return "{\"id\":\"" + String (HOSTNAME) + "\",\"upTime\":\"" + s + "\"}";
-                                                                                      }                                                                    
-              else if (httpRequest.substring (0, 14) == "GET /freeHeap ")             { // used by index.html
-                                                                                        return freeHeap.toJson (5);
-                                                                                      }
-              else if (httpRequest.substring (0, 22) == "GET /httpRequestCount ")     { // used by index.html
-                                                                                        return httpRequestCount.toJson (5);
-                                                                                      }
-              else if (httpRequest.substring (0, 17) == "GET /niceSwitch1 ")          { // used by example 05.html
-                                                                                      returnNiceSwitch1State:
-                                                                                        return "{\"id\":\"niceSwitch1\",\"value\":\"" + niceSwitch1 + "\"}"; // read switch state from variable or in some other way
-                                                                                      }
-              else if (httpRequest.substring (0, 17) == "PUT /niceSwitch1/")          { // used by example 05.html
-                                                                                        niceSwitch1 = httpRequest.substring (17, 22); // "true " or "false"
-                                                                                        niceSwitch1.trim ();
-                                                                                        Serial.println ("[Got request from web browser for niceSwitch1]: " + niceSwitch1 + "\n");
-                                                                                        goto returnNiceSwitch1State; // return success (or possible failure) back to the client
-                                                                                      }
-              else if (httpRequest.substring (0, 25) == "PUT /niceButton2/pressed ")  { // used by example 05.html
-                                                                                        Serial.printf ("[Got request from web browser for niceButton2]: pressed\n");
-                                                                                        return "{\"id\":\"niceButton2\",\"value\":\"pressed\"}"; // the client will actually not use this return value at all but we must return something
-                                                                                      }
-              else if (httpRequest.substring (0, 17) == "GET /niceSlider3 ")          { // used by example 05.html
-                                                                                      returnNiceSlider3Value:
-                                                                                        return "{\"id\":\"niceSlider3\",\"value\":\"" + String (niceSlider3) + "\"}"; // read slider value from variable or in some other way
-                                                                                      }
-              else if (httpRequest.substring (0, 17) == "PUT /niceSlider3/")          { // used by example 05.html
-                                                                                        niceSlider3 = httpRequest.substring (17, 19).toInt (); // 0 .. 10
-                                                                                        Serial.printf ("[Got request from web browser for niceSlider3]: %i\n", niceSlider3);
-                                                                                        goto returnNiceSlider3Value; // return success (or possible failure) back to the client
-                                                                                      }
-              else if (httpRequest.substring (0, 25) == "PUT /niceButton4/pressed ")  { // used by example 05.html
-                                                                                        Serial.printf ("[Got request from web browser for niceButton4]: pressed\n");
-                                                                                        return "{\"id\":\"niceButton4\",\"value\":\"pressed\"}"; // the client will actually not use this return value at all but we must return something
-                                                                                      }
-              else if (httpRequest.substring (0, 16) == "GET /niceRadio5 ")           { // used by example 05.html
-                                                                                      returnNiceRadio5Value:
-                                                                                        return "{\"id\":\"niceRadio5\",\"modulation\":\"" + niceRadio5 + "\"}"; // read radio button selection from variable or in some other way
-                                                                                      }
-              else if (httpRequest.substring (0, 16) == "PUT /niceRadio5/")           { // used by example 05.html
-                                                                                        niceRadio5 = httpRequest.substring (16, 18); // "am", "fm"
-                                                                                        Serial.printf ("[Got request from web browser for niceRadio5]: %s\n", niceRadio5.c_str ());
-                                                                                        goto returnNiceRadio5Value; // return success (or possible failure) back to the client
-                                                                                      }
-              else if (httpRequest.substring (0, 25) == "PUT /niceButton6/pressed ")  { // used by example 05.html                                                                                        Serial.printf ("[Got request from web browser for niceButton6]: pressed\n");
-                                                                                        return "{\"id\":\"niceButton6\",\"value\":\"pressed\"}"; // the client will actually not use this return value at all but we must return something
+              // GET /upTime, /freeHeap and /httpRequestCount (used by index.html) are handled by cached routes - see registerHttpRoutes below
+              else if (httpRequest.substring (0, 20) == "GET /httpStatistics ")       { // requests/s, bytes/s, latency percentiles and heap of web server - useful for benchmarking
+                                                                                        return wsp->server->getStatistics ();
                                                                                       }
+              // example 05 requests are handled by routes - see registerHttpRoutes below
               // ----- example 07: cookies
               else if (httpRequest.substring (0, 20) == "GET /example07.html ")       { // used by example 07
                                                                                         String refreshCounter = wsp->getHttpRequestCookie ("refreshCounter");           // get cookie that browser sent in HTTP request
@@ -167,12 +113,13 @@ String httpRequestHandler (String& httpRequest, httpServer::wwwSessionParameters
                                                                                         wsp->setHttpResponseCookie ("refreshCounter", refreshCounter, getGmt () + 60);  // set 1 minute valid cookie that will be send to browser in HTTP reply
                                                                                         return String ("<HTML>Example 07<br><br>This page has been refreshed " + refreshCounter + " times. Click refresh to see more.</HTML>");
                                                                                       }
-              // ----- a very basic login - logout mechanism, that could be improoved in many ways -----
+              // ----- a basic login - logout mechanism: user name and password are checked only once, then the browser identifies itself with a random sessionToken cookie -----
               else if (httpRequest.substring (0, 11) == "GET /login/")                { // GET /login/userName%20password - called from login.html when "Login" button is pressed 
                                                                                         String userName = between (httpRequest, "/login/", "%20");        // get user name from URL
                                                                                         String password = between (httpRequest, "%20", " ");              // get password from URL
-                                                                                        if (checkUserNameAndPassword (userName, password)) {              // check if they are OK
-                                                                                          wsp->setHttpResponseCookie ("sessionToken", "98376235");        // create (simple, demonstration) sessionToken cookie, path and expiration time (in GMT) can also be set
+                                                                                        String sessionToken;
+                                                                                        if (checkUserNameAndPassword (userName, password) && (sessionToken = wsp->server->openSession (userName)) != "") { // check if they are OK and open a new web session
+                                                                                          wsp->setHttpResponseCookie ("sessionToken", sessionToken);      // send session token to the browser in a cookie, path and expiration time (in GMT) can also be set
                                                                                           wsp->setHttpResponseCookie ("userName", userName);              // save user name in a cookie for later use
                                                                                           return "loggedIn";                                              // notify login.html about success  
                                                                                         } else {
@@ -182,14 +129,14 @@ String httpRequestHandler (String& httpRequest, httpServer::wwwSessionParameters
                                                                                         }
                                                                                       }
               else if (httpRequest.substring (0, 12) == "PUT /logout ")               { // called from logout.html when "Logout" button is pressed 
-                                                                                          if (wsp->getHttpRequestCookie ("sessionToken") == "98376235") { // if logged in
+                                                                                          if (wsp->server->closeSession (wsp->getHttpRequestCookie ("sessionToken"))) { // if logged in
                                                                                             wsp->setHttpResponseCookie ("sessionToken", "");              // delete sessionToken cookie if it exists
                                                                                             wsp->setHttpResponseCookie ("userName", "");                  // delete userName cookie if it exists
                                                                                           }
                                                                                           return "LoggedOut.";                                            // notify logout.html
                                                                                       }
               else if (httpRequest.substring (0, 17) == "GET /logout.html ")          { // logout.html may only be accessed if user is logged in
-                                                                                        if (wsp->getHttpRequestCookie ("sessionToken") == "98376235")     // check if browser has a valid sessionToken cookie
+                                                                                        if (wsp->getSessionUserName () != "")                             // check if browser has a valid sessionToken cookie (this also prolongs the session)
                                                                                           return "";                                                      // if yes, return "" so web server will continue with transmission of logout.html file
                                                                                          wsp->httpResponseStatus = "307 temporary redirect";              // if no, redirect browser to login.html
                                                                                          wsp->setHttpResponseHeaderField ("Location", "http://" + wsp->getHttpRequestHeaderField ("Host") + "/login.html");
@@ -200,6 +147,94 @@ String httpRequestHandler (String& httpRequest, httpServer::wwwSessionParameters
 }
 
 
+// ----- HTTP routes example - requests that httpRequestHandler doesn't handle (returns "") are looked up in httpServer's route table -----
+//       before they are served from the file system, each route has its own handler and {parameters} in path are extracted by httpServer,
+//       finding the route takes the same time regardless of how many routes are added
+
+// variables used by example 05
+String niceSwitch1 = "false";
+int niceSlider3 = 3;
+String niceRadio5 = "fm";
+
+void registerHttpRoutes (httpServer *httpSrv) {
+              // the last parameter is time-to-live of replies in ms: all browser tabs that poll these within this time get the same reply and the handler runs only once
+              httpSrv->addRoute ("GET", "/upTime", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String { // used by index.html
+                                                                                        time_t t = getUptime ();       // t holds seconds
+                                                                                        int seconds = t % 60; t /= 60; // t now holds minutes
+                                                                                        int minutes = t % 60; t /= 60; // t now holds hours
+                                                                                        int hours = t % 24;   t /= 24; // t now holds days
+                                                                                        char c [10];
+                                                                                        sprintf (c, "%02i:%02i:%02i", hours, minutes, seconds);
+                                                                                        String s = "";
+                                                                                        if (t) s += String ((unsigned long) t) + " days, ";
+                                                                                        s += String (c);
+                                                                                        return "{\"id\":\"" + String (HOSTNAME) + "\",\"upTime\":\"" + s + "\"}";
+                                                                                      }, 500);
+              httpSrv->addRoute ("GET", "/freeHeap", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String { // used by index.html
+                                                                                        return freeHeap.toJson (5);
+                                                                                      }, 5000);
+              httpSrv->addRoute ("GET", "/httpRequestCount", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String { // used by index.html
+                                                                                        return httpRequestCount.toJson (5);
+                                                                                      }, 5000);
+              // Server-Sent Events: index.html subscribes to /events once instead of polling /freeHeap and /httpRequestCount, new samples are pushed to it as they are taken
+              freeHeap.publishTo (httpSrv, "/events", "freeHeap", 5);
+              httpRequestCount.publishTo (httpSrv, "/events", "httpRequestCount", 5);
+              httpSrv->addRoute ("GET", "/niceSwitch1", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String { // used by example 05.html
+                                                                                        return "{\"id\":\"niceSwitch1\",\"value\":\"" + niceSwitch1 + "\"}"; // read switch state from variable or in some other way
+                                                                                      });
+              httpSrv->addRoute ("PUT", "/niceSwitch1/{value}", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String { // used by example 05.html
+                                                                                        niceSwitch1 = wsp->getHttpRequestPathParameter ("value").toString (); // "true" or "false"
+                                                                                        Serial.println ("[Got request from web browser for niceSwitch1]: " + niceSwitch1 + "\n");
+                                                                                        return "{\"id\":\"niceSwitch1\",\"value\":\"" + niceSwitch1 + "\"}"; // return success (or possible failure) back to the client
+                                                                                      });
+              httpSrv->addRoute ("PUT", "/niceButton2/pressed", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String { // used by example 05.html
+                                                                                        Serial.printf ("[Got request from web browser for niceButton2]: pressed\n");
+                                                                                        return "{\"id\":\"niceButton2\",\"value\":\"pressed\"}"; // the client will actually not use this return value at all but we must return something
+                                                                                      });
+              httpSrv->addRoute ("GET", "/niceSlider3", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String { // used by example 05.html
+                                                                                        return "{\"id\":\"niceSlider3\",\"value\":\"" + String (niceSlider3) + "\"}"; // read slider value from variable or in some other way
+                                                                                      });
+              httpSrv->addRoute ("PUT", "/niceSlider3/{value}", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String { // used by example 05.html
+                                                                                        niceSlider3 = wsp->getHttpRequestPathParameter ("value").toString ().toInt (); // 0 .. 10
+                                                                                        Serial.printf ("[Got request from web browser for niceSlider3]: %i\n", niceSlider3);
+                                                                                        return "{\"id\":\"niceSlider3\",\"value\":\"" + String (niceSlider3) + "\"}"; // return success (or possible failure) back to the client
+                                                                                      });
+              httpSrv->addRoute ("PUT", "/niceButton4/pressed", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String { // used by example 05.html
+                                                                                        Serial.printf ("[Got request from web browser for niceButton4]: pressed\n");
+                                                                                        return "{\"id\":\"niceButton4\",\"value\":\"pressed\"}"; // the client will actually not use this return value at all but we must return something
+                                                                                      });
+              httpSrv->addRoute ("GET", "/niceRadio5", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String { // used by example 05.html
+                                                                                        return "{\"id\":\"niceRadio5\",\"modulation\":\"" + niceRadio5 + "\"}"; // read radio button selection from variable or in some other way
+                                                                                      });
+              httpSrv->addRoute ("PUT", "/niceRadio5/{modulation}", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String { // used by example 05.html
+                                                                                        niceRadio5 = wsp->getHttpRequestPathParameter ("modulation").toString (); // "am", "fm"
+                                                                                        Serial.printf ("[Got request from web browser for niceRadio5]: %s\n", niceRadio5.c_str ());
+                                                                                        return "{\"id\":\"niceRadio5\",\"modulation\":\"" + niceRadio5 + "\"}"; // return success (or possible failure) back to the client
+                                                                                      });
+              httpSrv->addRoute ("PUT", "/niceButton6/pressed", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String { // used by example 05.html
+                                                                                        Serial.printf ("[Got request from web browser for niceButton6]: pressed\n");
+                                                                                        return "{\"id\":\"niceButton6\",\"value\":\"pressed\"}"; // the client will actually not use this return value at all but we must return something
+                                                                                      });
+              // streaming route: the reply is written in pieces through httpResponseWriter and sent with chunked transfer encoding, so it can be larger than free heap
+              httpSrv->addRoute ("GET", "/files", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp, httpServer::httpResponseWriter *response) { // JSON list of files in web server home directory
+                                                                                        response->setHeader ("Content-Type", "application/json");
+                                                                                        response->write ("[");
+                                                                                        File d = FFat.open (wsp->homeDir);
+                                                                                        if (d) {
+                                                                                          bool first = true;
+                                                                                          for (File f = d.openNextFile (); f; f = d.openNextFile ()) {
+                                                                                            bool written = response->write (String (first ? "" : ",") + "{\"name\":\"" + String (f.name ()) + "\",\"size\":" + String ((unsigned long) f.size ()) + "}");
+                                                                                            f.close ();
+                                                                                            if (!written) break; // connection lost
+                                                                                            first = false;
+                                                                                          }
+                                                                                          d.close ();
+                                                                                        }
+                                                                                        response->write ("]");
+                                                                                      });
+}
+
+
 // ----- WebSocket request handler example - if you don't want to handle WebSocket requests just delete this function and pass NULL to httpSrv instead of its address -----
 #include "./servers/oscilloscope.h"
 void wsRequestHandler (String& wsRequest, WebSocket *webSocket) { // - must be reentrant!
@@ -300,6 +335,13 @@ void setup () {
                                         80,                           // HTTP port
                                         NULL);                        // we won't use firewall callback function for HTTP server
   if (!httpSrv || (httpSrv && !httpSrv->started ())) dmesg ("[httpServer] did not start.");
+  else {
+    registerHttpRoutes (httpSrv);                                     // example 05 routes
+    httpSrv->setCacheControl ("/", "no-cache");                       // let browsers keep files but revalidate them (with ETag) each time, they will get 304 reply if the file hasn't changed
+    // httpSrv->setUploadDirectory ("/");                            // let PUT requests (curl -T file.html http://esp32/file.html) and upload.html (drag and drop) create or replace files - check who is making them in httpRequestHandler first
+    // httpSrv->startAccessLog ("/var/log/httpd.log");               // append a line for each request to /var/log/httpd.log (written in the background, rotated to httpd.log.1 when it gets larger than 64 KB)
+    // httpSrv->setRateLimit (10, 20);                                // let each client IP make 10 requests per second (with bursts of up to 20), reply with 429 to the rest
+  }
 
   // start FTP server
   ftpServer *ftpSrv = new ftpServer ((char *) "0.0.0.0",              // start FTP server on all available ip addresses
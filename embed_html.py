@@ -0,0 +1,104 @@
+# Embeds files from html/ directory into the firmware so that ESP32 web server can send them straight from flash.
+#
+# embedded_html.h is generated next to the sketch. Esp32_web_ftp_telnet_server_template.ino includes it if it exists
+# and web server then looks each requested file up in a perfect hash table (computed here, verified at compile time)
+# before trying the file cache or FFat: no file system access, no heap memory, the body goes to lwIP directly from flash.
+# Each file is stored gzip encoded (unless compression wouldn't make it smaller, like with .png files) together with its
+# Content-Type and an ETag computed from its content, so browsers revalidate with If-None-Match and get 304 replies.
+# Since ESP32 application partition is not large, gzip is the only encoding stored: the rare client that doesn't accept
+# gzip is served from FFat as before.
+#
+# Embedded files take precedence over the files with the same names in web server home directory (/var/www/html/), so
+# files uploaded later with FTP only take effect when the embedded copy is removed (delete embedded_html.h or run the script
+# again without the file) and the sketch is rebuilt.
+#
+# Run it each time files in html/ directory change, before building the sketch:  python embed_html.py [directory]
+
+import gzip
+import hashlib
+import os
+import sys
+
+directory = sys.argv [1] if len (sys.argv) > 1 else os.path.join (os.path.dirname (os.path.abspath (__file__)), "html")
+output = os.path.join (os.path.dirname (os.path.abspath (__file__)), "embedded_html.h")
+
+contentTypes = {".html": "text/html", ".htm": "text/html", ".css": "text/css", ".js": "application/javascript", ".json": "application/json", ".txt": "text/plain",
+                ".png": "image/png", ".jpg": "image/jpeg", ".jpeg": "image/jpeg", ".gif": "image/gif", ".ico": "image/x-icon", ".svg": "image/svg+xml"}
+
+def cString (s): # escape everything but plain characters, octal escapes (unlike \x) can't swallow the characters that follow
+    return '"' + "".join (chr (b) if b < 128 and (chr (b).isalnum () or chr (b) in "/._- ") else '\\"' if b == 34 else "\\%03o" % b for b in s.encode ("utf-8")) + '"'
+
+def fnv1a (name, seed): # must be the same as embeddedHtmlHash in embedded_html.h, case insensitive like FAT file names
+    h = seed
+    for b in name.encode ("utf-8"):
+        if 65 <= b <= 90:
+            b += 32
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+files = []
+for name in sorted (os.listdir (directory)):
+    path = os.path.join (directory, name)
+    if not os.path.isfile (path) or name.endswith (".gz"):
+        continue
+    with open (path, "rb") as f:
+        content = f.read ()
+    compressed = gzip.compress (content, compresslevel = 9, mtime = 0) # mtime = 0 so that the same file always gives the same content and ETag
+    gzipped = len (compressed) < len (content)
+    body = compressed if gzipped else content
+    files.append ({"name": name, "contentType": contentTypes.get (os.path.splitext (name) [1].lower (), "application/octet-stream"),
+                   "eTag": '"e' + hashlib.sha1 (content).hexdigest () [:16] + '"', "body": body, "gzipped": gzipped})
+    print ("%-30s %7i -> %6i bytes%s" % (name, len (content), len (body), "" if gzipped else ", not compressed"))
+
+if not files:
+    if os.path.exists (output):
+        os.remove (output) # nothing to embed, web server serves everything from FFat
+    sys.exit ("no files to embed in " + directory)
+
+# find a seed for which no two file names fall into the same slot of the hash table
+slots = 2 * len (files) + 1 # prime table size, the low bits of FNV hash alone depend only on the low bits of the name
+while any (slots % d == 0 for d in range (2, slots)):
+    slots += 1
+seed = 2166136261 # FNV offset basis
+while len (set (fnv1a (f ["name"], seed) % slots for f in files)) < len (files):
+    seed = (seed + 1) & 0xFFFFFFFF
+table = [-1] * slots
+for i, f in enumerate (files):
+    table [fnv1a (f ["name"], seed) % slots] = i
+
+with open (output, "w", newline = "\n") as h:
+    h.write ("// generated by embed_html.py from html/ directory, don't edit it, run python embed_html.py again when files in html/ change\n\n")
+    h.write ("#ifndef __EMBEDDED_HTML__\n  #define __EMBEDDED_HTML__\n\n")
+    h.write ("  struct embeddedHtmlFile {\n")
+    h.write ("    const char *fileName;     // relative to web server home directory\n")
+    h.write ("    const char *contentType;\n")
+    h.write ("    const char *eTag;         // computed from file content, including quotes\n")
+    h.write ("    const uint8_t *body;      // stays in flash\n")
+    h.write ("    size_t size;\n")
+    h.write ("    bool gzipped;             // body is gzip encoded\n")
+    h.write ("  };\n\n")
+    for i, f in enumerate (files):
+        h.write ("  static const uint8_t __embeddedHtmlBody%i__ [] = { // %s\n" % (i, f ["name"]))
+        for j in range (0, len (f ["body"]), 32):
+            h.write ("    " + ",".join (str (b) for b in f ["body"] [j:j + 32]) + ",\n")
+        h.write ("  };\n")
+    h.write ("\n  static const embeddedHtmlFile __embeddedHtmlFile__ [] = {\n")
+    for i, f in enumerate (files):
+        h.write ("    {%s, \"%s\", %s, __embeddedHtmlBody%i__, %i, %s},\n" % (cString (f ["name"]), f ["contentType"], cString (f ["eTag"]), i, len (f ["body"]), "true" if f ["gzipped"] else "false"))
+    h.write ("  };\n\n")
+    h.write ("  #define EMBEDDED_HTML_FILES %i\n\n" % len (files))
+    h.write ("  // perfect hash: each file name falls into its own slot, the other names have to be compared with the only file that may be there\n")
+    h.write ("  static const int16_t __embeddedHtmlSlot__ [%i] = {%s}; // file index or -1\n\n" % (slots, ",".join (str (t) for t in table)))
+    h.write ("  constexpr uint32_t embeddedHtmlHash (const char *s, size_t length, uint32_t h = %iu) { // FNV-1a, case insensitive like FAT file names\n" % seed)
+    h.write ("    return length ? embeddedHtmlHash (s + 1, length - 1, (h ^ (uint8_t) (*s >= 'A' && *s <= 'Z' ? *s + 32 : *s)) * 16777619u) : h;\n")
+    h.write ("  }\n\n")
+    for i, f in enumerate (files): # make sure the compiler computes the same hash as this script did
+        h.write ("  static_assert (embeddedHtmlHash (%s, %i) %% %i == %i, \"embedded_html.h is inconsistent, run embed_html.py again\");\n" % (cString (f ["name"]), len (f ["name"].encode ("utf-8")), slots, fnv1a (f ["name"], seed) % slots))
+    h.write ("\n  inline const embeddedHtmlFile *findEmbeddedHtmlFile (const char *fileName, size_t length) { // returns NULL if the file is not embedded\n")
+    h.write ("    int i = __embeddedHtmlSlot__ [embeddedHtmlHash (fileName, length) %% %i];\n" % slots)
+    h.write ("    if (i < 0 || strlen (__embeddedHtmlFile__ [i].fileName) != length || strncasecmp (__embeddedHtmlFile__ [i].fileName, fileName, length)) return NULL;\n")
+    h.write ("    return &__embeddedHtmlFile__ [i];\n")
+    h.write ("  }\n\n")
+    h.write ("#endif\n")
+
+print ("%i files embedded into %s" % (len (files), output))
@@ -0,0 +1,27 @@
+#!/bin/sh
+# Runs host_loadgen --suite against host_server and prints the results as JSON, labelled with the current commit.
+#
+#   host/benchmark.sh [build directory] [host_server options ...]     (default: build, --workers 4)
+#
+# Files from html/ are copied into a fresh $FFAT_ROOT (a temporary directory unless set), so /index.html is served from there.
+# Set CONNECTIONS and SECONDS to change the load (16 connections, 5 s per scenario by default), PORT to use another port (8080).
+
+BUILD=${1:-build}
+[ $# -gt 0 ] && shift
+[ $# -eq 0 ] && set -- --workers 4
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+PORT=${PORT:-8080}
+
+if [ -z "$FFAT_ROOT" ]; then FFAT_ROOT=$(mktemp -d); CLEANUP=$FFAT_ROOT; fi
+export FFAT_ROOT
+mkdir -p "$FFAT_ROOT/var/www/html" && cp "$ROOT"/html/* "$FFAT_ROOT/var/www/html/"
+
+"$BUILD/host_server" --port "$PORT" "$@" > "$FFAT_ROOT/host_server.log" 2>&1 &
+SERVER=$!
+sleep 1
+LABEL="$(git -C "$ROOT" rev-parse --short HEAD 2>/dev/null) $*"
+"$BUILD/host_loadgen" --suite --port "$PORT" --connections "${CONNECTIONS:-16}" --seconds "${SECONDS:-5}" --label "$LABEL"
+STATUS=$?
+kill $SERVER; wait $SERVER 2>/dev/null
+[ -n "$CLEANUP" ] && rm -rf "$CLEANUP"
+exit $STATUS
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Builds host_server with servers/ of an older commit and host/ of the working tree, so a change can be measured before and after:
+#
+#   host/build_commit.sh commit directory      (host_server is built into directory)
+#
+# Routes, route cache time-to-live and uploads that servers/ of the commit doesn't have yet are left out of host/server.cpp.
+
+set -e
+[ $# -eq 2 ] || { echo "usage: $0 commit directory" >&2; exit 1; }
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+D=$(mkdir -p "$2" && cd "$2" && pwd)
+rm -rf "$D/servers" "$D/host"
+git -C "$ROOT" archive "$1" servers | tar -x -C "$D"
+cp -r "$ROOT/host" "$D/host"
+
+python3 - "$D" <<'PY'
+import sys
+d = sys.argv [1]
+webServer = open (d + "/servers/webServer.hpp").read ()
+server = open (d + "/host/server.cpp").read ()
+def cut (s, start, end): return s [:s.index (start)] + s [s.index (end):] if start in s else s
+if "void setUploadDirectory" not in webServer: server = cut (server, "  if (uploadDirectory) {", "  ftpServer *ftpSrv")
+if "bool addRoute (const char" not in webServer: server = cut (server, "  httpSrv->addRoute (", "  ftpServer *ftpSrv")
+elif "unsigned long cacheMillis" not in webServer: server = server.replace ("\n  }, 500);", "\n  });")
+open (d + "/host/server.cpp", "w").write (server)
+PY
+
+g++ -std=gnu++17 -O2 -g -w -I"$D/host/shim" "$D/host/server.cpp" "$D/host/shim/freertos.cpp" "$D/host/shim/crypto.cpp" "$D/host/shim/heap.cpp" \
+    -o "$D/host_server" -lpthread -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+echo "$D/host_server"
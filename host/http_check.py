@@ -0,0 +1,210 @@
+# Checks Range requests, PUT uploads, multipart/form-data uploads, request body framing and HEAD requests against a running host_server and prints the results as JSON.
+#
+# host_server must be started with --upload /upload/, and $FFAT_ROOT must be the same as the server's, since the files are compared
+# with what the server has written there:
+#
+#   build/host_server --port 8080 --workers 4 --upload /upload/ &
+#   python3 host/http_check.py [--port 8080] [--bodies 60] [--seed 1] [range] [put] [multipart] [framing] [head]
+#
+# - range:     single byte ranges (first-last, first-, -suffix, past the end) of a cached and an uncached (4 MB) file are compared
+#              with the file itself,
+# - put:       a 4 MB file is uploaded with Content-Length and with chunked transfer encoding, the files written are compared with
+#              what was sent (and MB/s of each upload reported),
+# - multipart: random multipart/form-data bodies, with fragments of the boundary in the file data, are sent in pieces of random
+#              size (from 1 byte to the whole body) and the length and content of each file written is checked,
+# - framing:   requests whose body can't be framed unambiguously (Content-Length together with Transfer-Encoding, transfer codings
+#              other than exactly chunked) must be refused with 400, while a plain chunked request still gets through,
+# - head:      HEAD and GET requests for a file that is not cached yet, a cached one and an uncached (4 MB) one are pipelined on one
+#              connection: HEAD reply must have the same Content-Length as GET reply but no body, so GET reply must follow its header.
+#
+# Only the checks named are run (all of them if none is named). The script exits with 1 if any of them fails, --seed makes the random
+# bodies repeatable.
+
+import json
+import os
+import random
+import socket
+import sys
+import time
+
+port = 8080
+bodies = 60
+seed = 1
+checks = []
+i = 1
+while i < len (sys.argv):
+    if sys.argv [i] == "--port": port = int (sys.argv [i + 1]); i += 2
+    elif sys.argv [i] == "--bodies": bodies = int (sys.argv [i + 1]); i += 2
+    elif sys.argv [i] == "--seed": seed = int (sys.argv [i + 1]); i += 2
+    elif sys.argv [i] in ("range", "put", "multipart", "framing", "head"): checks.append (sys.argv [i]); i += 1
+    else: sys.exit ("usage: http_check.py [--port 8080] [--bodies 60] [--seed 1] [range] [put] [multipart] [framing] [head]")
+if not checks: checks = ["range", "put", "multipart", "framing", "head"]
+random.seed (seed)
+ffatRoot = os.environ.get ("FFAT_ROOT", "/tmp/ffat")
+home = os.path.join (ffatRoot, "var/www/html")
+uploads = os.path.join (home, "upload")
+
+def request (head, body = b"", pieces = None): # sends one request on a new connection (body in pieces if given), returns (status, header fields, body)
+    s = socket.create_connection (("127.0.0.1", port))
+    s.setsockopt (socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    s.settimeout (30)
+    s.sendall (head.encode ())
+    if pieces:
+        for p in pieces: s.sendall (p)
+    elif body: s.sendall (body)
+    reply = b""
+    while b"\r\n\r\n" not in reply:
+        r = s.recv (65536)
+        if not r: break
+        reply += r
+    header, _, content = reply.partition (b"\r\n\r\n")
+    lines = header.decode ("latin-1").split ("\r\n")
+    status = int (lines [0].split () [1]) if lines [0].startswith ("HTTP/") else -1
+    fields = {l.split (":", 1) [0].strip ().lower (): l.split (":", 1) [1].strip () for l in lines [1:] if ":" in l}
+    length = int (fields.get ("content-length", "0"))
+    if status in (204, 304) or head.startswith ("HEAD "): length = 0
+    while len (content) < length:
+        r = s.recv (65536)
+        if not r: break
+        content += r
+    s.close ()
+    return status, fields, content
+
+def get (path, extra = ""):
+    return request ("GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n" + extra + "\r\n")
+
+def randomPieces (body): # splits body into pieces of random size, sometimes 1 byte, sometimes the whole body
+    pieces = []
+    i = 0
+    while i < len (body):
+        n = random.choice ([1, 2, 7, 100, 1460, 4096, 20000, len (body)])
+        pieces.append (body [i:i + n])
+        i += n
+    return pieces
+
+results = {}
+failures = []
+
+# range
+if "range" in checks:
+    fileName = "4MB.bin"
+    with open (os.path.join (home, fileName), "wb") as f: f.write (random.randbytes (4 * 1024 * 1024)) # bigger than file cache, so it is read from FFat block by block
+    checked = 0
+    for name in ["oscilloscope.html", fileName]:
+        content = open (os.path.join (home, name), "rb").read ()
+        size = len (content)
+        get ("/" + name) # the first request brings small files into the cache
+        for r, expected in [("0-0", content [0:1]), ("100-199", content [100:200]), ("4000-12000", content [4000:12001]), ("1000-", content [1000:]),
+                            ("-500", content [-500:]), ("%i-%i" % (size - 10, size + 100), content [size - 10:])]:
+            status, fields, body = get ("/" + name, "Range: bytes=" + r + "\r\n")
+            checked += 1
+            if status != 206 or body != expected: failures.append ("range %s of %s: %i, %i bytes" % (r, name, status, len (body)))
+        status, fields, body = get ("/" + name, "Range: bytes=%i-\r\n" % size)
+        checked += 1
+        if status != 416 or fields.get ("content-range") != "bytes */%i" % size: failures.append ("range past the end of %s: %i" % (name, status))
+    results ["range"] = {"checked": checked}
+
+# put
+if "put" in checks:
+    content = random.randbytes (4 * 1024 * 1024)
+    put = {}
+    for name, chunked in [("put.bin", False), ("putChunked.bin", True)]:
+        startTime = time.time ()
+        if chunked:
+            chunks = []
+            i = 0
+            while i < len (content): # chunks of random size, so chunk boundaries don't fall on block boundaries
+                n = random.randint (1, 70000)
+                chunks.append (content [i:i + n])
+                i += n
+            body = b"".join (b"%x\r\n%s\r\n" % (len (c), c) for c in chunks) + b"0\r\n\r\n"
+            status, fields, reply = request ("PUT /upload/" + name + " HTTP/1.1\r\nHost: 127.0.0.1\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n", body)
+        else:
+            status, fields, reply = request ("PUT /upload/" + name + " HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: %i\r\nConnection: close\r\n\r\n" % len (content), content)
+        seconds = time.time () - startTime
+        written = open (os.path.join (uploads, name), "rb").read () if os.path.exists (os.path.join (uploads, name)) else b""
+        if status not in (201, 204) or written != content: failures.append ("put %s: %i, %i bytes written" % (name, status, len (written)))
+        put [name] = {"status": status, "bytes": len (content), "MBps": round (len (content) / seconds / 1e6, 1)}
+    results ["put"] = put
+
+# multipart
+if "multipart" in checks:
+    parts = 0
+    for b in range (bodies):
+        boundary = "----check" + "".join (random.choice ("0123456789abcdef") for _ in range (16))
+        files = []
+        body = b""
+        for p in range (random.randint (1, 4)):
+            data = bytearray (random.randbytes (random.choice ([0, 1, 50, 3000, 20000, 70000])))
+            for _ in range (random.randint (0, 5)): # fragments of the delimiter that must not end the part
+                fragment = (b"\r\n--" + boundary.encode ()) [:random.randint (1, len (boundary) + 3)]
+                at = random.randint (0, len (data))
+                data [at:at] = fragment
+            while (b"\r\n--" + boundary.encode ()) in data: # a random byte after a fragment may complete the delimiter, such data can't be sent in this body
+                data [data.index (b"\r\n--" + boundary.encode ()) + 2] ^= 1
+            name = "m%i_%i.bin" % (b, p)
+            files.append ((name, bytes (data)))
+            body += b"--" + boundary.encode () + b"\r\nContent-Disposition: form-data; name=\"file%i\"; filename=\"%s\"\r\nContent-Type: application/octet-stream\r\n\r\n" % (p, name.encode ()) + bytes (data) + b"\r\n"
+        body += b"--" + boundary.encode () + b"--\r\n"
+        status, fields, reply = request ("POST /upload/ HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Type: multipart/form-data; boundary=" + boundary +
+                                         "\r\nContent-Length: %i\r\nConnection: close\r\n\r\n" % len (body), pieces = randomPieces (body))
+        if status != 200: failures.append ("multipart body %i: %i" % (b, status))
+        for name, data in files:
+            parts += 1
+            path = os.path.join (uploads, name)
+            written = open (path, "rb").read () if os.path.exists (path) else None
+            if written != data: failures.append ("multipart body %i, %s: %s bytes written, %i sent" % (b, name, "no" if written is None else len (written), len (data)))
+            elif os.path.exists (path): os.remove (path)
+    results ["multipart"] = {"bodies": bodies, "parts": parts}
+
+# framing
+if "framing" in checks:
+    checked = 0
+    body = b"5\r\nhello\r\n0\r\n\r\n"
+    for fields, expected in [("Transfer-Encoding: chunked\r\nContent-Length: %i\r\n" % len (body), 400),
+                             ("Content-Length: %i\r\nTransfer-Encoding: chunked\r\n" % len (body), 400),
+                             ("Transfer-Encoding: gzip, chunked\r\n", 400),
+                             ("Transfer-Encoding: chunked, gzip\r\n", 400),
+                             ("Transfer-Encoding: chunkedx\r\n", 400),
+                             ("Transfer-Encoding: chunked\r\nTransfer-Encoding: chunked\r\n", 400),
+                             ("Transfer-Encoding: chunked\r\n", 201)]:
+        status, _, _ = request ("PUT /upload/framing.txt HTTP/1.1\r\nHost: 127.0.0.1\r\n" + fields + "Connection: close\r\n\r\n", body)
+        if os.path.exists (os.path.join (uploads, "framing.txt")): os.remove (os.path.join (uploads, "framing.txt")) # so that the next accepted PUT gets 201 again
+        checked += 1
+        if status != expected: failures.append ("framing %s: %i instead of %i" % (fields.replace ("\r\n", " ").strip (), status, expected))
+    results ["framing"] = {"checked": checked}
+
+# head
+if "head" in checks:
+    checked = 0
+    with open (os.path.join (home, "head.txt"), "wb") as f: f.write (random.randbytes (3000)) # not in the cache yet, HEAD request is the first one to read it
+    if not os.path.exists (os.path.join (home, "4MB.bin")):
+        with open (os.path.join (home, "4MB.bin"), "wb") as f: f.write (random.randbytes (4 * 1024 * 1024))
+    for name in ["head.txt", "oscilloscope.html", "4MB.bin"]:
+        content = open (os.path.join (home, name), "rb").read ()
+        s = socket.create_connection (("127.0.0.1", port))
+        s.settimeout (30)
+        s.sendall (("HEAD /" + name + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\nGET /" + name + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n").encode ())
+        reply = b""
+        while True:
+            r = s.recv (65536)
+            if not r: break
+            reply += r
+        s.close ()
+        replies = []
+        while reply and len (replies) < 2: # HEAD reply has no body, so whatever follows its header must be GET reply
+            header, _, reply = reply.partition (b"\r\n\r\n")
+            lines = header.decode ("latin-1").split ("\r\n")
+            fields = {l.split (":", 1) [0].strip ().lower (): l.split (":", 1) [1].strip () for l in lines [1:] if ":" in l}
+            length = 0 if not replies else int (fields.get ("content-length", "0"))
+            replies.append ((lines [0], fields.get ("content-length"), reply [:length]))
+            reply = reply [length:]
+        checked += 1
+        if len (replies) != 2 or reply or any (not r [0].startswith ("HTTP/1.1 200") or r [1] != str (len (content)) for r in replies) or replies [1][2] != content:
+            failures.append ("head %s: %s" % (name, [(r [0][:40], r [1], len (r [2])) for r in replies]))
+    os.remove (os.path.join (home, "head.txt"))
+    results ["head"] = {"checked": checked}
+
+results ["failures"] = failures
+print (json.dumps (results))
+sys.exit (1 if failures else 0)
@@ -0,0 +1,272 @@
+/*
+
+    loadgen.cpp
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    HTTP load generator: many concurrent clients send GET requests to httpServer (host_server or ESP32 itself) for a given time, over
+    persistent (keep-alive) connections or a new connection for each request, and the results are written to stdout as JSON, so they
+    can be compared across commits (see benchmark.sh and README.md):
+
+      host_loadgen [--host 127.0.0.1] [--port 8080] [--connections 16] [--seconds 5] [--close] [--label text] path [path ...]
+      host_loadgen --suite [--host 127.0.0.1] [--port 8080] [--connections 16] [--seconds 5] [--label text]
+
+    Each client sends the paths in turn and waits for each reply before it sends the next request. Latency is measured from sending
+    the request (or connecting, when each request has its own connection) until the whole reply has arrived. --suite runs /builtInLed,
+    /upTime and /index.html, each with keep-alive and with new connections. At the end the server's /httpStatistics is read to report
+    its free heap and the lowest free heap it has had (peakHeapUsed assumes --heap-size, HOST_HEAP_SIZE of host_server by default).
+
+*/
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <strings.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include "shim/heap.h" // HOST_HEAP_SIZE
+
+struct scenario {
+  std::string name;
+  std::vector<std::string> paths;
+  bool keepAlive;
+};
+
+struct result {                                                                 // what one client has measured
+  std::vector<unsigned long> latencyMicros;
+  unsigned long requests = 0;
+  unsigned long errors = 0;
+  unsigned long long bytesReceived = 0;
+  unsigned long statusCodes [600] = {};
+};
+
+static std::string __host__ = "127.0.0.1";
+static int __port__ = 8080;
+static int __connections__ = 16;
+static double __seconds__ = 5;
+static unsigned long __heapSize__ = HOST_HEAP_SIZE;
+
+static unsigned long __micros__ () { return std::chrono::duration_cast<std::chrono::microseconds> (std::chrono::steady_clock::now ().time_since_epoch ()).count (); }
+
+static int __connect__ (bool keepAlive) {
+  struct addrinfo hints = {}, *address;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo (__host__.c_str (), std::to_string (__port__).c_str (), &hints, &address)) return -1;
+  int s = socket (AF_INET, SOCK_STREAM, 0);
+  if (s >= 0 && connect (s, address->ai_addr, address->ai_addrlen)) { close (s); s = -1; }
+  freeaddrinfo (address);
+  if (s < 0) return -1;
+  int one = 1;
+  setsockopt (s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+  struct timeval timeout = {5, 0}; // a server that doesn't reply in 5 s counts as an error
+  setsockopt (s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+  if (!keepAlive) { struct linger l = {1, 0}; setsockopt (s, SOL_SOCKET, SO_LINGER, &l, sizeof (l)); } // reset instead of TIME_WAIT, so thousands of short connections don't use up local ports
+  return s;
+}
+
+class reader {                                                                  // buffered reading of one reply
+  public:
+    reader (int s): __socket__ (s) {}
+    bool fill () { // reads more data into the buffer, returns false if the connection has been closed or an error occurred
+      if (__head__ == __tail__) __head__ = __tail__ = 0;
+      if (__tail__ == sizeof (__buffer__)) { memmove (__buffer__, __buffer__ + __head__, __tail__ - __head__); __tail__ -= __head__; __head__ = 0; }
+      ssize_t n = recv (__socket__, __buffer__ + __tail__, sizeof (__buffer__) - __tail__, 0);
+      if (n <= 0) return false;
+      __tail__ += n;
+      bytesReceived += n;
+      return true;
+    }
+    bool line (std::string& l) { // reads one line without CRLF
+      while (true) {
+        char *end = (char *) memchr (__buffer__ + __head__, '\n', __tail__ - __head__);
+        if (end) { l.assign (__buffer__ + __head__, end - __buffer__ - __head__); if (!l.empty () && l.back () == '\r') l.pop_back (); __head__ = end - __buffer__ + 1; return true; }
+        if (__head__ == 0 && __tail__ == sizeof (__buffer__)) return false; // line too long
+        if (!fill ()) return false;
+      }
+    }
+    bool skip (unsigned long n) { // discards n bytes of body
+      while (n) {
+        if (__head__ == __tail__ && !fill ()) return false;
+        unsigned long k = std::min (n, (unsigned long) (__tail__ - __head__));
+        __head__ += k; n -= k;
+      }
+      return true;
+    }
+    bool skipToEnd () { __head__ = __tail__; while (fill ()) __head__ = __tail__; return true; } // body of a reply without Content-Length ends when the connection closes
+    unsigned long long bytesReceived = 0;
+  private:
+    int __socket__;
+    char __buffer__ [16 * 1024];
+    size_t __head__ = 0, __tail__ = 0;
+};
+
+static int __readReply__ (int s, bool& connectionClose, unsigned long long& bytesReceived) { // returns HTTP status code or -1
+  reader r (s);
+  std::string l;
+  int status = -1;
+  long contentLength = -1;
+  bool chunked = false;
+  bool http10 = false;
+  connectionClose = false;
+  if (!r.line (l) || l.compare (0, 5, "HTTP/") || l.size () < 12) return -1;
+  http10 = !l.compare (0, 8, "HTTP/1.0");
+  status = atoi (l.c_str () + 9);
+  bool keepAliveField = false;
+  while (true) {
+    if (!r.line (l)) return -1;
+    if (l.empty ()) break;
+    size_t colon = l.find (':');
+    if (colon == std::string::npos) continue;
+    std::string name = l.substr (0, colon), value = l.substr (colon + 1);
+    while (!value.empty () && value [0] == ' ') value.erase (0, 1);
+    if (!strcasecmp (name.c_str (), "Content-Length")) contentLength = atol (value.c_str ());
+    else if (!strcasecmp (name.c_str (), "Transfer-Encoding") && strcasestr (value.c_str (), "chunked")) chunked = true;
+    else if (!strcasecmp (name.c_str (), "Connection")) { if (strcasestr (value.c_str (), "close")) connectionClose = true; if (strcasestr (value.c_str (), "keep-alive")) keepAliveField = true; }
+  }
+  if (http10 && !keepAliveField) connectionClose = true;
+  bool ok = true;
+  if (status == 204 || status == 304 || (status >= 100 && status < 200)) ok = true; // no body
+  else if (chunked) {
+    while (ok) {
+      if (!r.line (l)) { ok = false; break; }
+      unsigned long size = strtoul (l.c_str (), NULL, 16);
+      if (!size) { while ((ok = r.line (l)) && !l.empty ()); break; } // trailer
+      ok = r.skip (size) && r.line (l);
+    }
+  } else if (contentLength >= 0) ok = r.skip (contentLength);
+  else { ok = r.skipToEnd (); connectionClose = true; }
+  bytesReceived += r.bytesReceived;
+  return ok ? status : -1;
+}
+
+static void __client__ (const scenario *sc, unsigned long deadlineMicros, result *res) {
+  int s = -1;
+  size_t pathIndex = 0;
+  while (__micros__ () < deadlineMicros) {
+    const std::string& path = sc->paths [pathIndex ++ % sc->paths.size ()];
+    unsigned long startMicros = __micros__ ();
+    if (s < 0 && (s = __connect__ (sc->keepAlive)) < 0) { res->errors ++; usleep (1000); continue; }
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + __host__ + "\r\nConnection: " + (sc->keepAlive ? "keep-alive" : "close") + "\r\n\r\n";
+    bool connectionClose = true;
+    int status = send (s, request.data (), request.size (), MSG_NOSIGNAL) == (ssize_t) request.size () ? __readReply__ (s, connectionClose, res->bytesReceived) : -1;
+    unsigned long endMicros = __micros__ ();
+    if (status < 0) res->errors ++;
+    else {
+      res->requests ++;
+      res->latencyMicros.push_back (endMicros - startMicros);
+      if (status < 600) res->statusCodes [status] ++;
+    }
+    if (status < 0 || connectionClose || !sc->keepAlive) { close (s); s = -1; } // the server may close a persistent connection after some requests, the client just opens a new one
+  }
+  if (s >= 0) close (s);
+}
+
+static unsigned long __percentile__ (const std::vector<unsigned long>& sorted, double p) { // nearest rank
+  if (sorted.empty ()) return 0;
+  size_t rank = (size_t) (p * sorted.size () + 0.999999);
+  return sorted [rank ? rank - 1 : 0];
+}
+
+static std::string __run__ (const scenario& sc) {
+  std::vector<result> results (__connections__);
+  std::vector<std::thread> clients;
+  unsigned long startMicros = __micros__ ();
+  unsigned long deadlineMicros = startMicros + (unsigned long) (__seconds__ * 1000000);
+  for (int i = 0; i < __connections__; i++) clients.emplace_back (__client__, &sc, deadlineMicros, &results [i]);
+  for (auto& c: clients) c.join ();
+  double seconds = (__micros__ () - startMicros) / 1e6;
+
+  result total;
+  for (auto& r: results) {
+    total.requests += r.requests;
+    total.errors += r.errors;
+    total.bytesReceived += r.bytesReceived;
+    total.latencyMicros.insert (total.latencyMicros.end (), r.latencyMicros.begin (), r.latencyMicros.end ());
+    for (int i = 0; i < 600; i++) total.statusCodes [i] += r.statusCodes [i];
+  }
+  std::sort (total.latencyMicros.begin (), total.latencyMicros.end ());
+  std::string paths, statusCodes;
+  for (auto& p: sc.paths) paths += (paths.empty () ? "\"" : ",\"") + p + "\"";
+  for (int i = 0; i < 600; i++) if (total.statusCodes [i]) statusCodes += (statusCodes.empty () ? "\"" : ",\"") + std::to_string (i) + "\":" + std::to_string (total.statusCodes [i]);
+  char json [1024];
+  snprintf (json, sizeof (json), "{\"name\":\"%s\",\"paths\":[%s],\"connections\":%i,\"keepAlive\":%s,\"seconds\":%.2f,\"requests\":%lu,\"errors\":%lu,"
+                                 "\"requestsPerSecond\":%.1f,\"bytesPerSecond\":%.0f,\"latencyMicros\":{\"p50\":%lu,\"p99\":%lu,\"p999\":%lu,\"max\":%lu},\"statusCodes\":{%s}}",
+            sc.name.c_str (), paths.c_str (), __connections__, sc.keepAlive ? "true" : "false", seconds, total.requests, total.errors,
+            total.requests / seconds, total.bytesReceived / seconds,
+            __percentile__ (total.latencyMicros, 0.50), __percentile__ (total.latencyMicros, 0.99), __percentile__ (total.latencyMicros, 0.999),
+            total.latencyMicros.empty () ? 0 : total.latencyMicros.back (), statusCodes.c_str ());
+  return json;
+}
+
+static long __statisticsField__ (const std::string& json, const char *name) { // finds "name":number in server's statistics
+  size_t i = json.find (std::string ("\"") + name + "\":");
+  return i == std::string::npos ? -1 : atol (json.c_str () + i + strlen (name) + 3);
+}
+
+static std::string __serverHeap__ () { // reads /httpStatistics once, with a connection of its own
+  int s = __connect__ (false);
+  if (s < 0) return "null";
+  std::string request = "GET /httpStatistics HTTP/1.1\r\nHost: " + __host__ + "\r\nConnection: close\r\n\r\n";
+  std::string reply;
+  char buffer [4096];
+  ssize_t n;
+  if (send (s, request.data (), request.size (), MSG_NOSIGNAL) == (ssize_t) request.size ()) while ((n = recv (s, buffer, sizeof (buffer), 0)) > 0) reply.append (buffer, n);
+  close (s);
+  long freeHeap = __statisticsField__ (reply, "freeHeap"), minFreeHeap = __statisticsField__ (reply, "minFreeHeap");
+  if (freeHeap < 0 || minFreeHeap < 0) return "null";
+  return "{\"freeHeap\":" + std::to_string (freeHeap) + ",\"minFreeHeap\":" + std::to_string (minFreeHeap) + ",\"peakHeapUsed\":" + std::to_string ((long) __heapSize__ - minFreeHeap) + "}";
+}
+
+int main (int argc, char **argv) {
+  bool suite = false, keepAlive = true;
+  std::string label;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp (argv [i], "--host") && i + 1 < argc)              __host__ = argv [++ i];
+    else if (!strcmp (argv [i], "--port") && i + 1 < argc)         __port__ = atoi (argv [++ i]);
+    else if (!strcmp (argv [i], "--connections") && i + 1 < argc)  __connections__ = atoi (argv [++ i]);
+    else if (!strcmp (argv [i], "--seconds") && i + 1 < argc)      __seconds__ = atof (argv [++ i]);
+    else if (!strcmp (argv [i], "--heap-size") && i + 1 < argc)    __heapSize__ = strtoul (argv [++ i], NULL, 10);
+    else if (!strcmp (argv [i], "--label") && i + 1 < argc)        label = argv [++ i];
+    else if (!strcmp (argv [i], "--close"))                        keepAlive = false;
+    else if (!strcmp (argv [i], "--suite"))                        suite = true;
+    else if (argv [i][0] == '/')                                   paths.push_back (argv [i]);
+    else { fprintf (stderr, "usage: %s [--host h] [--port p] [--connections n] [--seconds s] [--heap-size bytes] [--label text] (--suite | [--close] path ...)\n", argv [0]); return 1; }
+  }
+  if (!suite && paths.empty ()) { fprintf (stderr, "%s: no paths given (or use --suite)\n", argv [0]); return 1; }
+  if (__connections__ < 1) __connections__ = 1;
+  signal (SIGPIPE, SIG_IGN);
+
+  std::vector<scenario> scenarios;
+  if (suite) {
+    for (const char *p: {"/builtInLed", "/upTime", "/index.html"}) {
+      scenarios.push_back ({std::string (p) + " keep-alive", {p}, true});
+      scenarios.push_back ({std::string (p) + " close", {p}, false});
+    }
+  } else {
+    std::string name;
+    for (auto& p: paths) name += (name.empty () ? "" : " ") + p;
+    scenarios.push_back ({name + (keepAlive ? " keep-alive" : " close"), paths, keepAlive});
+  }
+
+  std::string json = "{\"label\":\"" + label + "\",\"host\":\"" + __host__ + "\",\"port\":" + std::to_string (__port__) + ",\"scenarios\":[";
+  for (size_t i = 0; i < scenarios.size (); i++) {
+    json += (i ? ",\n  " : "\n  ") + __run__ (scenarios [i]);
+    fprintf (stderr, "%s done\n", scenarios [i].name.c_str ());
+  }
+  json += "\n],\"serverHeap\":" + __serverHeap__ () + "}\n";
+  fputs (json.c_str (), stdout);
+  return 0;
+}
@@ -0,0 +1,90 @@
+/*
+
+    server.cpp
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    Runs httpServer (and optionally ftpServer) from servers/ directory on a Linux host, with Arduino, FreeRTOS and FFat replaced
+    by host shims (see shim/ directory and README.md). Files are served from $FFAT_ROOT/var/www/html/ ($FFAT_ROOT is /tmp/ffat
+    by default), the same way ESP32 serves them from FFat.
+
+      host_server [--port 8080] [--workers n | --reactor] [--upload directory] [--ftp port] [--seconds n]
+
+    --workers n   handle connections with a pool of n worker threads (see TcpServer), otherwise each connection gets its own thread
+    --reactor     handle all connections in one thread (see TcpServer)
+    --upload dir  allow PUT and multipart POST uploads into this directory (relative to /var/www/html/, see setUploadDirectory)
+    --ftp port    also start FTP server on this port
+    --seconds n   stop after n seconds instead of waiting for Ctrl-C (servers are deleted the same way as on ESP32)
+
+*/
+
+#include "shim/esp32_services.h"      // must be included before server headers, it replaces network.h and time_functions.h
+
+#define HOSTNAME "MyESP32Server"        // the same default as in network.h
+
+#define USER_MANAGEMENT NO_USER_MANAGEMENT // web server home directory is /var/www/html/, no /etc/passwd is needed
+#include "../servers/file_system.h"
+#include "../servers/user_management.h"
+#include "../servers/webServer.hpp"
+#include "../servers/ftpServer.hpp"
+
+#include <signal.h>
+
+static volatile bool __running__ = true;
+
+static void __stop__ (int) { __running__ = false; }
+
+String httpRequestHandler (String& httpRequest, httpServer::wwwSessionParameters *wsp) { // the same small dynamic reply as in Esp32_web_ftp_telnet_server_template.ino
+  #define httpRequestStartsWith(X) (httpRequest.substring (0, strlen (X)) == String (X))
+  if (httpRequestStartsWith ("GET /builtInLed ")) return "{\"id\":\"" + String (HOSTNAME) + "\",\"builtInLed\":\"off\"}\r\n";
+  return ""; // let routes and files in home directory handle the rest
+}
+
+int main (int argc, char **argv) {
+  int port = 8080, ftpPort = 0, workers = 0, seconds = 0;
+  const char *uploadDirectory = NULL;
+  bool reactor = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp (argv [i], "--port") && i + 1 < argc)          port = atoi (argv [++ i]);
+    else if (!strcmp (argv [i], "--workers") && i + 1 < argc)  workers = atoi (argv [++ i]);
+    else if (!strcmp (argv [i], "--reactor"))                  reactor = true;
+    else if (!strcmp (argv [i], "--upload") && i + 1 < argc)   uploadDirectory = argv [++ i];
+    else if (!strcmp (argv [i], "--ftp") && i + 1 < argc)      ftpPort = atoi (argv [++ i]);
+    else if (!strcmp (argv [i], "--seconds") && i + 1 < argc)  seconds = atoi (argv [++ i]);
+    else { fprintf (stderr, "usage: %s [--port 8080] [--workers n | --reactor] [--upload directory] [--ftp port] [--seconds n]\n", argv [0]); return 1; }
+  }
+  signal (SIGINT, __stop__);
+  signal (SIGTERM, __stop__);
+  signal (SIGPIPE, SIG_IGN); // lwIP doesn't raise signals when the other side closes the connection, host sockets do
+
+  mountFileSystem (false);
+  FFat.mkdir ("/var"); FFat.mkdir ("/var/www"); FFat.mkdir ("/var/www/html");
+
+  httpServer *httpSrv = new httpServer (httpRequestHandler, NULL, 8 * 1024, (char *) "0.0.0.0", port, NULL, reactor, workers);
+  if (!httpSrv || !httpSrv->started ()) { fprintf (stderr, "httpServer did not start on port %i\n", port); return 1; }
+  httpSrv->addRoute ("GET", "/upTime", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String { // the same cached route as in Esp32_web_ftp_telnet_server_template.ino
+    time_t t = getUptime ();
+    char c [32];
+    sprintf (c, "%02i:%02i:%02i", (int) (t / 3600 % 24), (int) (t / 60 % 60), (int) (t % 60));
+    String s = "";
+    if (t / 86400) s += String ((unsigned long) (t / 86400)) + " days, ";
+    s += String (c);
+    return "{\"id\":\"" + String (HOSTNAME) + "\",\"upTime\":\"" + s + "\"}";
+  }, 500);
+  httpSrv->addRoute ("GET", "/httpStatistics", [] (String& httpRequest, httpServer::wwwSessionParameters *wsp) -> String {
+    wsp->setHttpResponseHeaderField ("Content-Type", "application/json");
+    return wsp->server->getStatistics ();
+  });
+  if (uploadDirectory) {
+    FFat.mkdir ((String ("/var/www/html/") + (uploadDirectory [0] == '/' ? uploadDirectory + 1 : uploadDirectory)).c_str ());
+    httpSrv->setUploadDirectory (uploadDirectory);
+  }
+  ftpServer *ftpSrv = ftpPort ? new ftpServer ((char *) "0.0.0.0", ftpPort, NULL) : NULL;
+
+  unsigned long startMillis = millis ();
+  while (__running__ && (!seconds || millis () - startMillis < (unsigned long) seconds * 1000)) delay (100);
+
+  if (ftpSrv) delete ftpSrv;
+  delete httpSrv;
+  return 0;
+}
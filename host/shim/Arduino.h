@@ -0,0 +1,176 @@
+/*
+
+    Arduino.h (host shim)
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    The smallest part of Arduino core (String, millis, delay, Serial, ESP) and FreeRTOS (tasks, queues, semaphores, critical sections)
+    that server headers use, implemented on top of the C++ standard library and POSIX threads, so that TcpServer.hpp, webServer.hpp
+    and ftpServer.hpp can be built and run on a Linux host (see host/README.md). It is not meant to be complete - only what the
+    servers need is here. Critical sections are mutexes, tasks are detached pthreads, FFat is a directory on the host (see FFat.h).
+
+*/
+
+#ifndef __HOST_ARDUINO__
+  #define __HOST_ARDUINO__
+
+  #include <string>
+  #include <utility>
+  #include <cstring>
+  #include <cstdio>
+  #include <cstdlib>
+  #include <cstdint>
+  #include <cstdarg>
+  #include <cctype>
+  #include <ctime>
+  #include <cmath>
+  #include <cerrno>
+  #include <pthread.h>
+  #include <unistd.h>
+  #include <sys/time.h>
+  #include "heap.h"
+
+  typedef uint8_t byte;
+
+  inline unsigned long millis () { struct timeval tv; gettimeofday (&tv, NULL); return tv.tv_sec * 1000UL + tv.tv_usec / 1000; }
+  inline unsigned long micros () { struct timeval tv; gettimeofday (&tv, NULL); return tv.tv_sec * 1000000UL + tv.tv_usec; }
+  inline void delay (unsigned long ms) { usleep (ms * 1000); }
+  inline void yield () {}
+
+  class String {                                                                // the subset of Arduino String the servers use, kept in std::string
+    public:
+      std::string s;
+      String () {}
+      String (const char *c) { if (c) s = c; }
+      String (const std::string &x): s (x) {}
+      String (char c) { s = std::string (1, c); }
+      String (unsigned char v) { s = std::to_string (v); }
+      String (int v) { s = std::to_string (v); }
+      String (unsigned int v) { s = std::to_string (v); }
+      String (long v) { s = std::to_string (v); }
+      String (unsigned long v) { s = std::to_string (v); }
+      String (long long v) { s = std::to_string (v); }
+      String (unsigned long long v) { s = std::to_string (v); }
+      String (float v, unsigned int d = 2) { char b [64]; snprintf (b, sizeof (b), "%.*f", d, v); s = b; }
+      String (double v, unsigned int d = 2) { char b [64]; snprintf (b, sizeof (b), "%.*f", d, v); s = b; }
+      const char *c_str () const { return s.c_str (); }
+      unsigned int length () const { return s.length (); }
+      char charAt (unsigned int i) const { return i < s.length () ? s [i] : 0; }
+      char operator [] (unsigned int i) const { return charAt (i); }
+      int indexOf (char c, unsigned int from = 0) const { auto r = s.find (c, from); return r == std::string::npos ? -1 : (int) r; }
+      int indexOf (const String &x, unsigned int from = 0) const { auto r = s.find (x.s, from); return r == std::string::npos ? -1 : (int) r; }
+      int lastIndexOf (char c) const { auto r = s.rfind (c); return r == std::string::npos ? -1 : (int) r; }
+      String substring (unsigned int a) const { return a > s.length () ? String () : String (s.substr (a)); }
+      String substring (unsigned int a, unsigned int b) const { if (a > b) std::swap (a, b); if (a > s.length ()) return String (); return String (s.substr (a, b - a)); }
+      void trim () { size_t a = s.find_first_not_of (" \t\r\n"); if (a == std::string::npos) { s = ""; return; } size_t b = s.find_last_not_of (" \t\r\n"); s = s.substr (a, b - a + 1); }
+      long toInt () const { return atol (s.c_str ()); }
+      float toFloat () const { return atof (s.c_str ()); }
+      void toUpperCase () { for (auto &c: s) c = toupper (c); }
+      void toLowerCase () { for (auto &c: s) c = tolower (c); }
+      bool equals (const String &x) const { return s == x.s; }
+      bool equalsIgnoreCase (const String &x) const { return s.size () == x.s.size () && !strncasecmp (s.c_str (), x.s.c_str (), s.size ()); }
+      bool endsWith (const String &x) const { return s.size () >= x.s.size () && s.compare (s.size () - x.s.size (), x.s.size (), x.s) == 0; }
+      bool startsWith (const String &x) const { return s.compare (0, x.s.size (), x.s) == 0; }
+      void replace (const char *a, const char *b) { std::string f (a), t (b); if (f.empty ()) return; size_t p = 0; while ((p = s.find (f, p)) != std::string::npos) { s.replace (p, f.size (), t); p += t.size (); } }
+      void remove (unsigned int i) { if (i < s.size ()) s.erase (i); }
+      void remove (unsigned int i, unsigned int n) { if (i < s.size ()) s.erase (i, n); }
+      bool reserve (unsigned int n) { s.reserve (n); return true; }
+      bool concat (const char *c, unsigned int n) { s.append (c, n); return true; }
+      bool concat (const String &x) { s += x.s; return true; }
+      String &operator += (const String &x) { s += x.s; return *this; }
+      String &operator += (const char *x) { s += x; return *this; }
+      String &operator += (char x) { s += x; return *this; }
+      bool operator == (const String &x) const { return s == x.s; }
+      bool operator == (const char *x) const { return s == x; }
+      bool operator != (const String &x) const { return s != x.s; }
+      bool operator != (const char *x) const { return s != x; }
+      bool operator > (const String &x) const { return s > x.s; }
+      bool operator < (const String &x) const { return s < x.s; }
+      bool operator >= (const String &x) const { return s >= x.s; }
+      bool operator <= (const String &x) const { return s <= x.s; }
+      explicit operator bool () const { return true; }
+  };
+  inline String operator + (const String &a, const String &b) { return String (a.s + b.s); }
+  inline String operator + (const String &a, const char *b) { return String (a.s + b); }
+  inline String operator + (const char *a, const String &b) { return String (a + b.s); }
+  inline String operator + (const String &a, char b) { return String (a.s + b); }
+
+  class HardwareSerial {
+    public:
+      void begin (int) {}
+      int printf (const char *f, ...) { va_list a; va_start (a, f); int r = vprintf (f, a); va_end (a); fflush (stdout); return r; }
+      void println (const String &x) { ::printf ("%s\n", x.c_str ()); }
+      void print (const String &x) { ::printf ("%s", x.c_str ()); }
+  };
+  static HardwareSerial Serial;
+
+  class EspClass {                                                              // heap is counted as if the host had HOST_HEAP_SIZE bytes of it (see heap.cpp)
+    public:
+      uint32_t getHeapSize () { return HOST_HEAP_SIZE; }
+      uint32_t getFreeHeap () { return hostHeapUsed () < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - hostHeapUsed () : 0; }
+      uint32_t getMinFreeHeap () { return hostHeapPeak () < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - hostHeapPeak () : 0; }
+      uint32_t getMaxAllocHeap () { return hostHeapLargestFreeBlock (); }
+      const char *getSdkVersion () { return "host"; }
+      void restart () {}
+  };
+  static EspClass ESP;
+
+  inline uint32_t esp_random () { return (uint32_t) random (); }
+  inline void digitalWrite (int, int) {}
+  inline int digitalRead (int) { return 0; }
+  inline void pinMode (int, int) {}
+  #define HIGH 1
+  #define LOW 0
+  #define OUTPUT 1
+
+  // FreeRTOS (implemented in freertos.cpp), ticks are milliseconds
+  typedef int BaseType_t;
+  typedef unsigned int UBaseType_t;
+  typedef uint32_t TickType_t;
+  typedef void *TaskHandle_t;
+  typedef void *QueueHandle_t;
+  typedef void *SemaphoreHandle_t;
+  typedef void *EventGroupHandle_t;
+  typedef uint32_t EventBits_t;
+  #define pdPASS 1
+  #define pdFAIL 0
+  #define pdTRUE 1
+  #define pdFALSE 0
+  #define portMAX_DELAY 0xffffffff
+  #define portTICK_PERIOD_MS 1
+  #define pdMS_TO_TICKS(x) (x)
+  BaseType_t xTaskCreate (void (*taskFunction) (void *), const char *name, uint32_t stackSize, void *parameter, UBaseType_t priority, TaskHandle_t *taskHandle);
+  void vTaskDelete (TaskHandle_t taskHandle);                                   // only vTaskDelete (NULL) (the calling task ends) is supported
+  void vTaskDelay (TickType_t ticks);
+  TaskHandle_t xTaskGetCurrentTaskHandle ();
+  TickType_t xTaskGetTickCount ();
+  BaseType_t xTaskNotifyGive (TaskHandle_t taskHandle);
+  uint32_t ulTaskNotifyTake (BaseType_t clearCountOnExit, TickType_t ticksToWait);
+  inline int xPortGetCoreID () { return 0; }
+  QueueHandle_t xQueueCreate (UBaseType_t length, UBaseType_t itemSize);
+  BaseType_t xQueueSend (QueueHandle_t queue, const void *item, TickType_t ticksToWait);
+  BaseType_t xQueueReceive (QueueHandle_t queue, void *item, TickType_t ticksToWait);
+  UBaseType_t uxQueueMessagesWaiting (QueueHandle_t queue);
+  void vQueueDelete (QueueHandle_t queue);
+  SemaphoreHandle_t xSemaphoreCreateMutex ();
+  SemaphoreHandle_t xSemaphoreCreateBinary ();
+  BaseType_t xSemaphoreTake (SemaphoreHandle_t semaphore, TickType_t ticksToWait);
+  BaseType_t xSemaphoreGive (SemaphoreHandle_t semaphore);
+  void vSemaphoreDelete (SemaphoreHandle_t semaphore);
+  EventGroupHandle_t xEventGroupCreate ();
+  EventBits_t xEventGroupSetBits (EventGroupHandle_t eventGroup, EventBits_t bitsToSet);
+  EventBits_t xEventGroupClearBits (EventGroupHandle_t eventGroup, EventBits_t bitsToClear);
+  EventBits_t xEventGroupWaitBits (EventGroupHandle_t eventGroup, EventBits_t bitsToWaitFor, BaseType_t clearOnExit, BaseType_t waitForAllBits, TickType_t ticksToWait);
+  void vEventGroupDelete (EventGroupHandle_t eventGroup);
+
+  struct portMUX_TYPE { pthread_mutex_t m; };                                   // critical sections are plain mutexes on the host
+  #define portMUX_INITIALIZER_UNLOCKED { PTHREAD_MUTEX_INITIALIZER }
+  #define portENTER_CRITICAL(x) pthread_mutex_lock (&(x)->m)
+  #define portEXIT_CRITICAL(x) pthread_mutex_unlock (&(x)->m)
+
+  #define RTC_DATA_ATTR
+  #define log_e(...)
+  #define log_i(...)
+  #define log_v(...)
+
+#endif
@@ -0,0 +1,96 @@
+/*
+
+    FFat.h (host shim)
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    FFat file system on the host is a directory: $FFAT_ROOT or /tmp/ffat if FFAT_ROOT is not set. FFat paths (/var/www/html/index.html)
+    are appended to it. Only the File and FFat member functions the servers use are implemented.
+
+*/
+
+#ifndef __HOST_FFAT__
+  #define __HOST_FFAT__
+
+  #include "Arduino.h"
+  #include <dirent.h>
+  #include <sys/stat.h>
+
+  #define FILE_READ "r"
+  #define FILE_WRITE "w"
+  #define FILE_APPEND "a"
+
+  enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+  inline std::string __ffatRoot__ () { const char *r = getenv ("FFAT_ROOT"); return r ? r : "/tmp/ffat"; }
+
+  class File {
+    public:
+      File () {}
+      explicit operator bool () const { return f != NULL || d != NULL; }
+      size_t size () { if (!f) return 0; fflush (f); struct stat st; fstat (fileno (f), &st); return st.st_size; }
+      int available () { if (!f) return 0; long p = ftell (f); return (int) (size () - p); }
+      int read () { if (!f) return -1; return fgetc (f); }
+      int peek () { if (!f) return -1; int c = fgetc (f); if (c != EOF) ungetc (c, f); return c; }
+      size_t read (uint8_t *b, size_t n) { return f ? fread (b, 1, n, f) : 0; }
+      size_t readBytes (char *b, size_t n) { return f ? fread (b, 1, n, f) : 0; }
+      size_t write (const uint8_t *b, size_t n) { return f ? fwrite (b, 1, n, f) : 0; }
+      size_t write (uint8_t b) { return f ? fwrite (&b, 1, 1, f) : 0; }
+      int printf (const char *fmt, ...) { if (!f) return 0; va_list a; va_start (a, fmt); int r = vfprintf (f, fmt, a); va_end (a); return r; }
+      size_t print (const String &s) { return write ((const uint8_t *) s.c_str (), s.length ()); }
+      bool seek (uint32_t pos, SeekMode m = SeekSet) { return f && !fseek (f, pos, m == SeekSet ? SEEK_SET : m == SeekCur ? SEEK_CUR : SEEK_END); }
+      size_t position () { return f ? ftell (f) : 0; }
+      void flush () { if (f) fflush (f); }
+      void close () { if (f) fclose (f); f = NULL; if (d) closedir (d); d = NULL; }
+      bool isDirectory () { return d != NULL; }
+      const char *name () { return n.c_str (); }
+      time_t getLastWrite () { struct stat st; if (stat ((__ffatRoot__ () + n).c_str (), &st)) return 0; return st.st_mtime; }
+      File openNextFile () {
+        File r;
+        if (!d) return r;
+        while (struct dirent *e = readdir (d)) {
+          if (!strcmp (e->d_name, ".") || !strcmp (e->d_name, "..")) continue;
+          std::string p = n + (n.size () && n.back () == '/' ? "" : "/") + e->d_name;
+          std::string hostPath = __ffatRoot__ () + p;
+          struct stat st;
+          if (stat (hostPath.c_str (), &st)) continue;
+          r.n = p;
+          if (S_ISDIR (st.st_mode)) r.d = opendir (hostPath.c_str ()); else r.f = fopen (hostPath.c_str (), "rb");
+          return r;
+        }
+        return r;
+      }
+
+      FILE *f = NULL;
+      DIR *d = NULL;
+      std::string n;
+  };
+
+  class FFatClass {
+    public:
+      bool begin (bool formatOnFail = false) { return true; }
+      void end () {}
+      bool format () { return true; }
+      File open (const char *p, const char *m = FILE_READ) {
+        File r;
+        r.n = p;
+        std::string hostPath = __ffatRoot__ () + p;
+        struct stat st;
+        if (!stat (hostPath.c_str (), &st) && S_ISDIR (st.st_mode)) { r.d = opendir (hostPath.c_str ()); return r; }
+        r.f = fopen (hostPath.c_str (), *m == 'r' ? "rb" : *m == 'w' ? "wb" : "ab");
+        return r;
+      }
+      File open (const String &p, const char *m = FILE_READ) { return open (p.c_str (), m); }
+      bool exists (const String &p) { struct stat st; return !stat ((__ffatRoot__ () + p.c_str ()).c_str (), &st); }
+      bool exists (const char *p) { return exists (String (p)); }
+      bool remove (const String &p) { return !::remove ((__ffatRoot__ () + p.c_str ()).c_str ()); }
+      bool mkdir (const String &p) { return !::mkdir ((__ffatRoot__ () + p.c_str ()).c_str (), 0755); }
+      bool rmdir (const String &p) { return !::rmdir ((__ffatRoot__ () + p.c_str ()).c_str ()); }
+      bool rename (const String &a, const String &b) { return !exists (b) && !::rename ((__ffatRoot__ () + a.c_str ()).c_str (), (__ffatRoot__ () + b.c_str ()).c_str ()); } // like FAT, doesn't replace existing files
+      size_t totalBytes () { return 1 << 20; }
+      size_t usedBytes () { return 1 << 19; }
+      size_t freeBytes () { return 1 << 19; }
+  };
+  static FFatClass FFat;
+
+#endif
@@ -0,0 +1,21 @@
+/*
+
+    WiFi.h (host shim)
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    Servers include WiFi.h to get Arduino core, on the host it only brings in Arduino.h and what network.h needs.
+
+*/
+
+#ifndef __HOST_WIFI__
+  #define __HOST_WIFI__
+
+  #include "Arduino.h"
+
+  typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+  class WiFiClass { public: int RSSI () { return 0; } };
+  static WiFiClass WiFi;
+
+#endif
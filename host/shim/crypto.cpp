@@ -0,0 +1,143 @@
+/*
+
+    crypto.cpp (host shim)
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    SHA-1, SHA-256 (FIPS 180-4) and base64 (RFC 4648) in software, standing in for ESP32 hardware SHA and mbedTLS on the host.
+
+*/
+
+#include <cstring>
+#include "hwcrypto/sha.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/md.h"
+
+static inline uint32_t __rol__ (uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+static inline uint32_t __ror__ (uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+// SHA-1
+
+static void __sha1Block__ (uint32_t h [5], const unsigned char *block) {
+  uint32_t w [80];
+  for (int i = 0; i < 16; i++) w [i] = (uint32_t) block [4 * i] << 24 | (uint32_t) block [4 * i + 1] << 16 | (uint32_t) block [4 * i + 2] << 8 | block [4 * i + 3];
+  for (int i = 16; i < 80; i++) w [i] = __rol__ (w [i - 3] ^ w [i - 8] ^ w [i - 14] ^ w [i - 16], 1);
+  uint32_t a = h [0], b = h [1], c = h [2], d = h [3], e = h [4];
+  for (int i = 0; i < 80; i++) {
+    uint32_t f, k;
+    if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+    else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+    else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+    else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+    uint32_t t = __rol__ (a, 5) + f + e + k + w [i];
+    e = d; d = c; c = __rol__ (b, 30); b = a; a = t;
+  }
+  h [0] += a; h [1] += b; h [2] += c; h [3] += d; h [4] += e;
+}
+
+// SHA-256
+
+static const uint32_t __sha256K__ [64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void __sha256Block__ (uint32_t h [8], const unsigned char *block) {
+  uint32_t w [64];
+  for (int i = 0; i < 16; i++) w [i] = (uint32_t) block [4 * i] << 24 | (uint32_t) block [4 * i + 1] << 16 | (uint32_t) block [4 * i + 2] << 8 | block [4 * i + 3];
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = __ror__ (w [i - 15], 7) ^ __ror__ (w [i - 15], 18) ^ (w [i - 15] >> 3);
+    uint32_t s1 = __ror__ (w [i - 2], 17) ^ __ror__ (w [i - 2], 19) ^ (w [i - 2] >> 10);
+    w [i] = w [i - 16] + s0 + w [i - 7] + s1;
+  }
+  uint32_t a = h [0], b = h [1], c = h [2], d = h [3], e = h [4], f = h [5], g = h [6], hh = h [7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = hh + (__ror__ (e, 6) ^ __ror__ (e, 11) ^ __ror__ (e, 25)) + ((e & f) ^ (~e & g)) + __sha256K__ [i] + w [i];
+    uint32_t t2 = (__ror__ (a, 2) ^ __ror__ (a, 13) ^ __ror__ (a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+  }
+  h [0] += a; h [1] += b; h [2] += c; h [3] += d; h [4] += e; h [5] += f; h [6] += g; h [7] += hh;
+}
+
+// both hashes pad the message the same way: 0x80, zeros, 64 bit big endian length in bits
+
+static void __shaPadAndFinish__ (uint32_t *h, void (*blockFunction) (uint32_t *, const unsigned char *), unsigned char *block, size_t blockLength, uint64_t totalLength) {
+  block [blockLength ++] = 0x80;
+  if (blockLength > 56) { memset (block + blockLength, 0, 64 - blockLength); blockFunction (h, block); blockLength = 0; }
+  memset (block + blockLength, 0, 56 - blockLength);
+  for (int i = 0; i < 8; i++) block [56 + i] = (unsigned char) ((totalLength * 8) >> (56 - 8 * i));
+  blockFunction (h, block);
+}
+
+void esp_sha (esp_sha_type type, const unsigned char *input, size_t length, unsigned char *output) {
+  if (type == SHA2_256) {
+    mbedtls_md_context_t ctx;
+    mbedtls_md_starts (&ctx);
+    mbedtls_md_update (&ctx, input, length);
+    mbedtls_md_finish (&ctx, output);
+    return;
+  }
+  uint32_t h [5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  unsigned char block [64];
+  size_t i = 0;
+  for (; i + 64 <= length; i += 64) __sha1Block__ (h, input + i);
+  memcpy (block, input + i, length - i);
+  __shaPadAndFinish__ (h, __sha1Block__, block, length - i, length);
+  for (int j = 0; j < 20; j++) output [j] = (unsigned char) (h [j / 4] >> (24 - 8 * (j % 4)));
+}
+
+static const mbedtls_md_info_t __sha256Info__ = {MBEDTLS_MD_SHA256};
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type (mbedtls_md_type_t type) { return type == MBEDTLS_MD_SHA256 ? &__sha256Info__ : NULL; }
+
+void mbedtls_md_init (mbedtls_md_context_t *ctx) { memset (ctx, 0, sizeof (*ctx)); }
+
+int mbedtls_md_setup (mbedtls_md_context_t *ctx, const mbedtls_md_info_t *info, int hmac) { return info && !hmac ? 0 : -1; } // HMAC is not supported
+
+int mbedtls_md_starts (mbedtls_md_context_t *ctx) {
+  static const uint32_t initial [8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  memcpy (ctx->state, initial, sizeof (initial));
+  ctx->length = 0;
+  ctx->blockLength = 0;
+  return 0;
+}
+
+int mbedtls_md_update (mbedtls_md_context_t *ctx, const unsigned char *input, size_t length) {
+  ctx->length += length;
+  while (length) {
+    size_t n = 64 - ctx->blockLength < length ? 64 - ctx->blockLength : length;
+    memcpy (ctx->block + ctx->blockLength, input, n);
+    ctx->blockLength += n; input += n; length -= n;
+    if (ctx->blockLength == 64) { __sha256Block__ (ctx->state, ctx->block); ctx->blockLength = 0; }
+  }
+  return 0;
+}
+
+int mbedtls_md_finish (mbedtls_md_context_t *ctx, unsigned char *output) {
+  __shaPadAndFinish__ (ctx->state, __sha256Block__, ctx->block, ctx->blockLength, ctx->length);
+  for (int j = 0; j < 32; j++) output [j] = (unsigned char) (ctx->state [j / 4] >> (24 - 8 * (j % 4)));
+  return 0;
+}
+
+void mbedtls_md_free (mbedtls_md_context_t *ctx) { memset (ctx, 0, sizeof (*ctx)); }
+
+// base64
+
+int mbedtls_base64_encode (unsigned char *destination, size_t destinationLength, size_t *outputLength, const unsigned char *source, size_t sourceLength) {
+  static const char alphabet [] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t needed = 4 * ((sourceLength + 2) / 3) + 1; // including the closing 0
+  if (destinationLength < needed) { *outputLength = needed; return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL; }
+  size_t o = 0;
+  for (size_t i = 0; i < sourceLength; i += 3) {
+    uint32_t v = (uint32_t) source [i] << 16 | (i + 1 < sourceLength ? (uint32_t) source [i + 1] << 8 : 0) | (i + 2 < sourceLength ? source [i + 2] : 0);
+    destination [o ++] = alphabet [(v >> 18) & 63];
+    destination [o ++] = alphabet [(v >> 12) & 63];
+    destination [o ++] = i + 1 < sourceLength ? alphabet [(v >> 6) & 63] : '=';
+    destination [o ++] = i + 2 < sourceLength ? alphabet [v & 63] : '=';
+  }
+  destination [o] = 0;
+  *outputLength = o;
+  return 0;
+}
@@ -0,0 +1,31 @@
+/*
+
+    esp32_services.h (host shim)
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    Host replacements for servers/network.h and servers/time_functions.h, which talk to WiFi, SNTP and the RTC. Include it before
+    server headers: it defines __NETWORK__ and __TIME_FUNCTIONS__, so the originals (that server headers include) are skipped.
+    The host clock counts as set, unless HOST_CLOCK_NOT_SET environment variable is defined - then getGmt () returns 0, as it does
+    on ESP32 before the time has been synchronized with NTP servers.
+
+*/
+
+#ifndef __HOST_ESP32_SERVICES__
+  #define __HOST_ESP32_SERVICES__
+
+  #include <WiFi.h>
+
+  #define __NETWORK__
+  #define __TIME_FUNCTIONS__
+
+  inline wifi_mode_t getWiFiMode () { return WIFI_STA; }
+
+  inline time_t getGmt () { return getenv ("HOST_CLOCK_NOT_SET") ? 0 : time (NULL); }
+  inline time_t getUptime () { static unsigned long startMillis = millis (); return (millis () - startMillis) / 1000; }
+  inline time_t timeToLocalTime (time_t t) { return t; }
+  inline time_t getLocalTime () { return getGmt (); }
+  inline struct tm timeToStructTime (time_t t) { struct tm st; gmtime_r (&t, &st); return st; }
+  inline String timeToString (time_t t) { struct tm st = timeToStructTime (t); char s [25]; strftime (s, sizeof (s), "%Y/%m/%d %H:%M:%S", &st); return String (s); }
+
+#endif
@@ -0,0 +1,178 @@
+/*
+
+    freertos.cpp (host shim)
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    FreeRTOS tasks, task notifications, queues, semaphores and event groups declared in Arduino.h, implemented with POSIX threads and the C++ standard library.
+    Semaphores are counting semaphores made of a mutex and a condition variable, so (unlike std::mutex) they can be given by
+    another task than the one that took them, as FreeRTOS binary semaphores can.
+
+*/
+
+#include "Arduino.h"
+#include <deque>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+static std::chrono::milliseconds __ticks__ (TickType_t ticks) { return std::chrono::milliseconds (ticks == portMAX_DELAY ? 1000000000UL : ticks); }
+
+struct __task__ { void (*f) (void *); void *p; };
+
+static void *__runTask__ (void *t) {
+  __task__ task = *(__task__ *) t;
+  delete (__task__ *) t;
+  task.f (task.p);
+  return NULL;
+}
+
+BaseType_t xTaskCreate (void (*taskFunction) (void *), const char *, uint32_t, void *parameter, UBaseType_t, TaskHandle_t *taskHandle) {
+  pthread_t thread;
+  pthread_attr_t attributes;
+  pthread_attr_init (&attributes);
+  pthread_attr_setdetachstate (&attributes, PTHREAD_CREATE_DETACHED);
+  __task__ *t = new __task__ {taskFunction, parameter};
+  if (pthread_create (&thread, &attributes, __runTask__, t)) { delete t; return pdFAIL; }
+  if (taskHandle) *taskHandle = (TaskHandle_t) thread;
+  return pdPASS;
+}
+
+void vTaskDelete (TaskHandle_t taskHandle) { if (!taskHandle) pthread_exit (NULL); }
+
+void vTaskDelay (TickType_t ticks) { delay (ticks); }
+
+TaskHandle_t xTaskGetCurrentTaskHandle () { return (TaskHandle_t) pthread_self (); }
+
+TickType_t xTaskGetTickCount () { return millis (); }
+
+// task notifications: a counter for each task (thread) that has been notified and hasn't taken all the notifications yet
+static std::mutex __notificationMutex__;
+static std::condition_variable __notificationCondition__;
+static std::map<pthread_t, uint32_t> __notificationValue__;
+
+BaseType_t xTaskNotifyGive (TaskHandle_t taskHandle) {
+  std::unique_lock<std::mutex> l (__notificationMutex__);
+  __notificationValue__ [(pthread_t) taskHandle] ++;
+  __notificationCondition__.notify_all ();
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake (BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+  pthread_t self = pthread_self ();
+  std::unique_lock<std::mutex> l (__notificationMutex__);
+  __notificationCondition__.wait_for (l, __ticks__ (ticksToWait), [self] { return __notificationValue__.count (self) > 0; });
+  auto n = __notificationValue__.find (self);
+  if (n == __notificationValue__.end ()) return 0; // timed out
+  uint32_t value = n->second; // FreeRTOS returns the value before it is cleared or decremented
+  if (clearCountOnExit || value == 1) __notificationValue__.erase (n); else n->second --;
+  return value;
+}
+
+struct __queue__ {
+  std::mutex m;
+  std::condition_variable c;
+  std::deque<std::vector<char>> items;
+  size_t length, itemSize;
+};
+
+QueueHandle_t xQueueCreate (UBaseType_t length, UBaseType_t itemSize) {
+  __queue__ *q = new __queue__;
+  q->length = length;
+  q->itemSize = itemSize;
+  return q;
+}
+
+BaseType_t xQueueSend (QueueHandle_t queue, const void *item, TickType_t ticksToWait) {
+  __queue__ *q = (__queue__ *) queue;
+  std::unique_lock<std::mutex> l (q->m);
+  if (!q->c.wait_for (l, __ticks__ (ticksToWait), [q] { return q->items.size () < q->length; })) return pdFAIL;
+  q->items.emplace_back ((const char *) item, (const char *) item + q->itemSize);
+  q->c.notify_all ();
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive (QueueHandle_t queue, void *item, TickType_t ticksToWait) {
+  __queue__ *q = (__queue__ *) queue;
+  std::unique_lock<std::mutex> l (q->m);
+  if (!q->c.wait_for (l, __ticks__ (ticksToWait), [q] { return !q->items.empty (); })) return pdFAIL;
+  memcpy (item, q->items.front ().data (), q->itemSize);
+  q->items.pop_front ();
+  q->c.notify_all ();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting (QueueHandle_t queue) {
+  __queue__ *q = (__queue__ *) queue;
+  std::unique_lock<std::mutex> l (q->m);
+  return q->items.size ();
+}
+
+void vQueueDelete (QueueHandle_t queue) { delete (__queue__ *) queue; }
+
+struct __semaphore__ {
+  std::mutex m;
+  std::condition_variable c;
+  unsigned int count;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex () { return new __semaphore__ {{}, {}, 1}; }
+
+SemaphoreHandle_t xSemaphoreCreateBinary () { return new __semaphore__ {{}, {}, 0}; } // created empty, like in FreeRTOS
+
+BaseType_t xSemaphoreTake (SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+  __semaphore__ *s = (__semaphore__ *) semaphore;
+  std::unique_lock<std::mutex> l (s->m);
+  if (!s->c.wait_for (l, __ticks__ (ticksToWait), [s] { return s->count > 0; })) return pdFALSE;
+  s->count --;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive (SemaphoreHandle_t semaphore) {
+  __semaphore__ *s = (__semaphore__ *) semaphore;
+  std::unique_lock<std::mutex> l (s->m);
+  if (s->count) return pdFALSE; // binary semaphores and mutexes can't be given twice
+  s->count = 1;
+  s->c.notify_one ();
+  return pdTRUE;
+}
+
+void vSemaphoreDelete (SemaphoreHandle_t semaphore) { delete (__semaphore__ *) semaphore; }
+
+struct __eventGroup__ {
+  std::mutex m;
+  std::condition_variable c;
+  EventBits_t bits;
+};
+
+EventGroupHandle_t xEventGroupCreate () { return new __eventGroup__ {{}, {}, 0}; }
+
+EventBits_t xEventGroupSetBits (EventGroupHandle_t eventGroup, EventBits_t bitsToSet) {
+  __eventGroup__ *g = (__eventGroup__ *) eventGroup;
+  std::unique_lock<std::mutex> l (g->m);
+  g->bits |= bitsToSet;
+  g->c.notify_all (); // unlike semaphores, setting bits wakes up all the tasks waiting for them
+  return g->bits;
+}
+
+EventBits_t xEventGroupClearBits (EventGroupHandle_t eventGroup, EventBits_t bitsToClear) {
+  __eventGroup__ *g = (__eventGroup__ *) eventGroup;
+  std::unique_lock<std::mutex> l (g->m);
+  EventBits_t bits = g->bits; // FreeRTOS returns the bits as they were before clearing
+  g->bits &= ~bitsToClear;
+  return bits;
+}
+
+EventBits_t xEventGroupWaitBits (EventGroupHandle_t eventGroup, EventBits_t bitsToWaitFor, BaseType_t clearOnExit, BaseType_t waitForAllBits, TickType_t ticksToWait) {
+  __eventGroup__ *g = (__eventGroup__ *) eventGroup;
+  std::unique_lock<std::mutex> l (g->m);
+  auto satisfied = [g, bitsToWaitFor, waitForAllBits] { return waitForAllBits ? (g->bits & bitsToWaitFor) == bitsToWaitFor : (g->bits & bitsToWaitFor) != 0; };
+  bool waited = g->c.wait_for (l, __ticks__ (ticksToWait), satisfied);
+  EventBits_t bits = g->bits; // on time-out FreeRTOS returns the bits as they are, the caller checks which of them are set
+  if (waited && clearOnExit) g->bits &= ~bitsToWaitFor;
+  return bits;
+}
+
+void vEventGroupDelete (EventGroupHandle_t eventGroup) { delete (__eventGroup__ *) eventGroup; }
@@ -0,0 +1,64 @@
+/*
+
+    heap.cpp (host shim)
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    Counts the heap the program uses, so that ESP.getFreeHeap () and ESP.getMinFreeHeap () tell on the host how much heap the servers
+    would take on ESP32. The program is linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free (see CMakeLists.txt),
+    so its calls go through __wrap_* functions here, and operator new / delete are replaced to use them too. Allocations made inside
+    the C library itself are not counted.
+
+*/
+
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <malloc.h>
+#include "heap.h"
+
+extern "C" {
+  void *__real_malloc (size_t size);
+  void *__real_calloc (size_t count, size_t size);
+  void *__real_realloc (void *p, size_t size);
+  void __real_free (void *p);
+}
+
+static std::atomic<size_t> __heapUsed__ (0);
+static std::atomic<size_t> __heapPeak__ (0);
+
+static void __allocated__ (void *p) {
+  if (!p) return;
+  size_t used = (__heapUsed__ += malloc_usable_size (p));
+  size_t peak = __heapPeak__.load ();
+  while (used > peak && !__heapPeak__.compare_exchange_weak (peak, used));
+}
+
+static void __freeing__ (void *p) { if (p) __heapUsed__ -= malloc_usable_size (p); }
+
+extern "C" {
+  void *__wrap_malloc (size_t size) { void *p = __real_malloc (size); __allocated__ (p); return p; }
+  void *__wrap_calloc (size_t count, size_t size) { void *p = __real_calloc (count, size); __allocated__ (p); return p; }
+  void *__wrap_realloc (void *p, size_t size) {
+    size_t oldSize = p ? malloc_usable_size (p) : 0;
+    void *q = __real_realloc (p, size);
+    if (q || !size) { __heapUsed__ -= oldSize; __allocated__ (q); } // if realloc fails the old block stays allocated
+    return q;
+  }
+  void __wrap_free (void *p) { __freeing__ (p); __real_free (p); }
+}
+
+void *operator new (size_t size) { void *p = malloc (size ? size : 1); if (!p) throw std::bad_alloc (); return p; }
+void *operator new [] (size_t size) { return operator new (size); }
+void *operator new (size_t size, const std::nothrow_t &) noexcept { return malloc (size ? size : 1); }
+void *operator new [] (size_t size, const std::nothrow_t &) noexcept { return malloc (size ? size : 1); }
+void operator delete (void *p) noexcept { free (p); }
+void operator delete [] (void *p) noexcept { free (p); }
+void operator delete (void *p, size_t) noexcept { free (p); }
+void operator delete [] (void *p, size_t) noexcept { free (p); }
+
+size_t hostHeapUsed () { return __heapUsed__; }
+
+size_t hostHeapPeak () { return __heapPeak__; }
+
+size_t hostHeapLargestFreeBlock () { size_t used = __heapUsed__; return used < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - used : 0; }
@@ -0,0 +1,25 @@
+/*
+
+    heap.h (host shim)
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    Heap accounting for ESP.getFreeHeap () and ESP.getMinFreeHeap () on the host (see heap.cpp): every malloc, calloc, realloc, free
+    and operator new / delete of the program is counted, as if it had HOST_HEAP_SIZE bytes of heap like ESP32.
+
+*/
+
+#ifndef __HOST_HEAP__
+  #define __HOST_HEAP__
+
+  #include <cstddef>
+
+  #ifndef HOST_HEAP_SIZE
+    #define HOST_HEAP_SIZE (320 * 1024) // about what ESP32 Arduino sketch has when it starts
+  #endif
+
+  size_t hostHeapUsed ();                                                       // bytes allocated at the moment
+  size_t hostHeapPeak ();                                                       // the most bytes that were allocated at the same time
+  size_t hostHeapLargestFreeBlock ();
+
+#endif
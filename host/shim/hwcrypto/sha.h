@@ -0,0 +1,20 @@
+/*
+
+    hwcrypto/sha.h (host shim)
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    ESP32 hardware SHA, computed in software on the host (see crypto.cpp). webServer.hpp needs SHA-1 for WebSocket handshake.
+
+*/
+
+#ifndef __HOST_HWCRYPTO_SHA__
+  #define __HOST_HWCRYPTO_SHA__
+
+  #include <cstddef>
+
+  enum esp_sha_type { SHA1 = 0, SHA2_256 };
+
+  void esp_sha (esp_sha_type type, const unsigned char *input, size_t length, unsigned char *output);
+
+#endif
@@ -0,0 +1,26 @@
+/*
+
+    lwip/sockets.h (host shim)
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    lwIP implements BSD sockets, so on the host the servers use the host's own sockets.
+
+*/
+
+#ifndef __HOST_LWIP_SOCKETS__
+  #define __HOST_LWIP_SOCKETS__
+
+  #include <sys/socket.h>
+  #include <sys/select.h>
+  #include <sys/uio.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <arpa/inet.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <errno.h>
+
+  typedef struct { uint32_t addr; } ip_addr_t;
+
+#endif
@@ -0,0 +1,20 @@
+/*
+
+    mbedtls/base64.h (host shim)
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    Base64 encoding as mbedTLS does it (see crypto.cpp), webServer.hpp needs it for WebSocket handshake.
+
+*/
+
+#ifndef __HOST_MBEDTLS_BASE64__
+  #define __HOST_MBEDTLS_BASE64__
+
+  #include <cstddef>
+
+  #define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL -0x002A
+
+  int mbedtls_base64_encode (unsigned char *destination, size_t destinationLength, size_t *outputLength, const unsigned char *source, size_t sourceLength);
+
+#endif
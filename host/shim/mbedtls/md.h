@@ -0,0 +1,37 @@
+/*
+
+    mbedtls/md.h (host shim)
+
+    This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
+
+    The part of mbedTLS message digest interface user_management.h uses to hash passwords, only SHA-256 is supported (see crypto.cpp).
+
+*/
+
+#ifndef __HOST_MBEDTLS_MD__
+  #define __HOST_MBEDTLS_MD__
+
+  #include <cstddef>
+  #include <cstdint>
+
+  typedef int mbedtls_md_type_t;
+  #define MBEDTLS_MD_SHA256 6
+
+  typedef struct { mbedtls_md_type_t type; } mbedtls_md_info_t;
+
+  typedef struct {
+    uint32_t state [8];
+    uint64_t length;                                                            // bytes hashed so far
+    unsigned char block [64];
+    size_t blockLength;
+  } mbedtls_md_context_t;
+
+  const mbedtls_md_info_t *mbedtls_md_info_from_type (mbedtls_md_type_t type);
+  void mbedtls_md_init (mbedtls_md_context_t *ctx);
+  int mbedtls_md_setup (mbedtls_md_context_t *ctx, const mbedtls_md_info_t *info, int hmac);
+  int mbedtls_md_starts (mbedtls_md_context_t *ctx);
+  int mbedtls_md_update (mbedtls_md_context_t *ctx, const unsigned char *input, size_t length);
+  int mbedtls_md_finish (mbedtls_md_context_t *ctx, unsigned char *output);
+  void mbedtls_md_free (mbedtls_md_context_t *ctx);
+
+#endif
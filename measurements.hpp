@@ -5,6 +5,7 @@
  *  This file is part of Esp32_web_ftp_telnet_server_template project: https://github.com/BojanJurca/Esp32_web_ftp_telnet_server_template
  * 
  *  Measurements.hpp include circular queue for storing measurements data set.
+ *  If webServer.hpp is included first, measurements can also be pushed to web browsers as Server-Sent Events (see publishTo).
  * 
  * History:
  *          - first release, October 31, 2018, Bojan Jurca
@@ -48,6 +49,7 @@
                                                     this->__end__ = (this->__end__ + 1) % (this->__noOfSamples__ + 1); 
                                                     if (this->__end__ == this->__beginning__) this->__beginning__ = (this->__beginning__ + 1) % (this->__noOfSamples__ + 1); 
                                                   portEXIT_CRITICAL (&csMeasurementsInternalStructure);
+                                                  __publish__ ();
                                                 }  
   
       void increaseCounter ()                   {               // increase internal counter (that is not added to measurements yet))
@@ -66,7 +68,18 @@
                                                     this->__end__ = (this->__end__ + 1) % (this->__noOfSamples__ + 1); 
                                                     if (this->__end__ == this->__beginning__) this->__beginning__ = (this->__beginning__ + 1) % (this->__noOfSamples__ + 1); 
                                                   portEXIT_CRITICAL (&csMeasurementsInternalStructure);
+                                                  __publish__ ();
                                                 }  
+
+      #ifdef __WEB_SERVER__
+        void publishTo (httpServer *server, const char *eventStreamPath, const char *eventName, int scaleModule) { // each time a sample is added the data set (the same json as toJson returns) is pushed as eventName event to eventStreamPath subscribers
+                                                  server->addEventStream (eventStreamPath);
+                                                  this->__server__ = server;
+                                                  this->__eventStreamPath__ = eventStreamPath;
+                                                  this->__eventName__ = eventName;
+                                                  this->__scaleModule__ = scaleModule;
+                                                }
+      #endif
                                                 
       String toJson (int scaleModule) {                           // returns json structure of measurements
                                                   struct measurementType tmp;
@@ -100,6 +113,19 @@
       int __beginning__;                                            // last occupied location
       int __end__;                                                  // first free location (if it is the same as __beginning__ then the queue is empty)
       int __counter__ = 0;
+
+      #ifdef __WEB_SERVER__
+        httpServer *__server__ = NULL;                              // publishTo settings
+        const char *__eventStreamPath__;
+        const char *__eventName__;
+        int __scaleModule__;
+      #endif
+
+      void __publish__ ()                       { // toJson is only called when somebody is listening, so unwatched measurements cost (almost) nothing
+                                                  #ifdef __WEB_SERVER__
+                                                    if (this->__server__ && this->__server__->hasEventSubscribers (this->__eventStreamPath__)) this->__server__->publishEvent (this->__eventStreamPath__, this->__eventName__, toJson (this->__scaleModule__));
+                                                  #endif
+                                                }
                                               
   };
 
@@ -0,0 +1,30 @@
+# Precompresses files in html/ directory so that ESP32 web server can send them gzip encoded.
+#
+# For each file (index.html, oscilloscope.html, ...) a file.gz sibling is created (index.html.gz, oscilloscope.html.gz, ...)
+# unless compression wouldn't make the file smaller (like with .png files). Upload .gz files with FTP into /var/www/html/
+# directory together with (or instead of) the original files. When a browser sends Accept-Encoding: gzip (all of them do)
+# web server replies with file.gz and Content-Encoding: gzip, otherwise it replies with the original file.
+#
+# Run it each time files in html/ directory change:  python precompress_html.py [directory]
+
+import gzip
+import os
+import sys
+
+directory = sys.argv [1] if len (sys.argv) > 1 else os.path.join (os.path.dirname (os.path.abspath (__file__)), "html")
+
+for name in sorted (os.listdir (directory)):
+    path = os.path.join (directory, name)
+    if not os.path.isfile (path) or name.endswith (".gz"):
+        continue
+    with open (path, "rb") as f:
+        content = f.read ()
+    compressed = gzip.compress (content, compresslevel = 9, mtime = 0) # mtime = 0 so that the same file always gives the same .gz
+    if len (compressed) >= len (content):
+        if os.path.exists (path + ".gz"):
+            os.remove (path + ".gz") # don't leave outdated .gz behind
+        print ("%-30s %7i bytes, not compressed" % (name, len (content)))
+        continue
+    with open (path + ".gz", "wb") as f:
+        f.write (compressed)
+    print ("%-30s %7i -> %6i bytes (%.1fx)" % (name, len (content), len (compressed), len (content) / len (compressed)))
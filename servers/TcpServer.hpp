@@ -6,11 +6,13 @@
 
     TcpServer.hpp contains a minimalistic IPv4 threaded TCP server for ESP32 / Arduino environment with:
       - time-out functionality,
-      - firewall functionality.
+      - firewall functionality,
+      - per client IP rate limiting.
 
-    Four types of objects are introduced in order to make programming interface as simple as possible
+    Five types of objects are introduced in order to make programming interface as simple as possible
     (a programmer does not have to deal with sockets and threads by himself):
       - threaded TcpServer (with firewall functionality),
+      - reactor TcpServer (one thread handles all connections, with firewall functionality - connectionEventCallback must not block, only httpServer uses it),
       - non-threaded TcpServer (with time-out functionality while waiting for a connection, firewall functionality),
       - TcpConnection (with time-out functionality while handling a connection),
       - non-threaded TcpClient (with time-out functionality while handling the connection).
@@ -58,6 +60,7 @@ void (* TcpDmesg) (String) = __TcpDmesg__; // use this pointer to display / reco
 
 #include <WiFi.h>
 #include <lwip/sockets.h>
+#include <errno.h> // lwIP reports EAGAIN or EINPROGRESS (119 in newlib) on non-blocking sockets that are not ready yet, take the values from errno.h rather than hard-coding them so that the code also compiles (and works) against other socket implementations
 
 // TcpConnection can be used in two different modes:
 // - threaded TcpConnection creates a new thread and runs connectionHandlerCallback function through it
@@ -68,6 +71,10 @@ void (* TcpDmesg) (String) = __TcpDmesg__; // use this pointer to display / reco
 // - non-threaded TcpConnection can be controlled from calling program
 //    you must delete () instance yourself when no longer needed
 
+#ifndef TCP_CONNECTION_RX_BUFFER_SIZE
+  #define TCP_CONNECTION_RX_BUFFER_SIZE 512 // receive buffer used by readLine, readUntil, readExactly and peek - it is only allocated when one of these functions gets called
+#endif
+
 // controll TcpServer critical sections
 portMUX_TYPE csTcpConnectionInternalStructure = portMUX_INITIALIZER_UNLOCKED;
 
@@ -116,20 +123,7 @@ class TcpConnection {
       __timeOutMillis__ = timeOutMillis;
 
       // start connection handler thread (threaded mode)
-      __connectionState__ = TcpConnection::RUNNING;
-      if (connectionHandlerCallback) {
-        #define tskNORMAL_PRIORITY 1
-        if (pdPASS != xTaskCreate ( __connectionHandler__,
-                                    "TcpConnection",
-                                    stackSize,
-                                    this, // pass "this" pointer to static member function
-                                    tskNORMAL_PRIORITY,
-                                    NULL)) {
-          __connectionState__ = TcpConnection::NOT_STARTED;
-          // log_e ("[Thread:%lu][Core:%i][Socket:%i] threaded constructor: xTaskCreate () error\n", (unsigned long) xTaskGetCurrentTaskHandle (), xPortGetCoreID (), socket);
-          // TO DO: make constructor return NULL
-        }
-      }
+      if (connectionHandlerCallback) __startThread__ (stackSize);
       // log_v ("[Thread:%lu][Core:%i][Socket:%i] } threaded constructor\n", (unsigned long) xTaskGetCurrentTaskHandle (), xPortGetCoreID (), socket);
     }
 
@@ -154,9 +148,11 @@ class TcpConnection {
       closeConnection ();
       // wait for __connectionHandler__ to finish before releasing the memory occupied by this instance
       while (__connectionState__ < TcpConnection::FINISHED) delay (1);
+      __unlink__ (); // let TcpServer know the connection is gone
       // __connectionHandler__ thread will terminate itself
       // log_v ("[Thread:%lu][Core:%i][Socket:%i] } destructor\n", (unsigned long) xTaskGetCurrentTaskHandle (), xPortGetCoreID (), __socket__);
       // Serial.printf ("~TcpConnection ()\n");
+      if (__rxBuffer__) free (__rxBuffer__);
     }
 
     virtual void closeConnection ()           {
@@ -167,6 +163,13 @@ class TcpConnection {
         __socket__ = -1;
       portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
       if (connectionSocket != -1) { // can not close socket inside of critical section, close it now
+        while (true) { // but not while TcpServer::stop is shutting it down, the socket number could meanwhile be reused by a connection of another server
+          portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+            bool shutDownInProgress = __shutDownInProgress__;
+          portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+          if (!shutDownInProgress) break;
+          delay (1);
+        }
         // if (shutdown (connectionSocket, SHUT_RD) == -1) log_e ("[Thread:%i][Core:%i][Socket:%i] closeConnection: shutdown () error %i\n", xTaskGetCurrentTaskHandle (), xPortGetCoreID (), __socket__, errno);
         // if (close (connectionSocket) == -1);            // log_e ("[Thread:%i][Core:%i][Socket:%i] closeConnection: close () error %i\n", xTaskGetCurrentTaskHandle (), xPortGetCoreID (), __socket__, errno);
         close (connectionSocket);
@@ -204,19 +207,69 @@ class TcpConnection {
     virtual int recvData (char *buffer, int bufferSize)                   // returns the number of bytes actually received or 0 indicating error or closed connection
     {
       // Serial.printf ("recvData (%lu, %i)\n", (unsigned long) buffer, bufferSize);
+      if (__rxHead__ < __rxTail__) { // first return what readLine, readUntil, ... have already read into receive buffer
+        int received = __rxTail__ - __rxHead__ < bufferSize ? __rxTail__ - __rxHead__ : bufferSize;
+        memcpy (buffer, __rxBuffer__ + __rxHead__, received);
+        __rxHead__ += received;
+        return received;
+      }
+      return __recvFromSocket__ (buffer, bufferSize);
+    }
+
+    // buffered reading: the following functions read incoming data in blocks into receive buffer instead of calling recv () for each character,
+    // recvData and available () take data already in receive buffer into account so they can be freely mixed with them,
+    // (select () doesn't know about receive buffer though, so reactor connection event handlers should use only recvData)
+
+    int peek ()                               { // returns the next incoming byte without consuming it or -1 indicating error or closed connection, waits for data to arrive if needed
+      if (!__fillRxBuffer__ ()) return -1;
+      return (unsigned char) __rxBuffer__ [__rxHead__];
+    }
+
+    int readExactly (char *buffer, int bufferSize) { // returns bufferSize or less if error occured or connection closed before all the data arrived
+      int readTotal = 0;
+      while (readTotal < bufferSize) {
+        if (__rxHead__ == __rxTail__ && bufferSize - readTotal >= TCP_CONNECTION_RX_BUFFER_SIZE) { // large blocks don't need to go through receive buffer
+          int received = __recvFromSocket__ (buffer + readTotal, bufferSize - readTotal);
+          if (!received) break;
+          readTotal += received;
+        } else {
+          if (!__fillRxBuffer__ ()) break;
+          readTotal += recvData (buffer + readTotal, bufferSize - readTotal);
+        }
+      }
+      return readTotal;
+    }
+
+    bool readUntil (String& s, char delimiter) { // appends incoming data to s until delimiter arrives (delimiter is consumed but not appended), returns false indicating error or closed connection
+      while (__fillRxBuffer__ ()) {
+        char *d = (char *) memchr (__rxBuffer__ + __rxHead__, delimiter, __rxTail__ - __rxHead__);
+        int l = d ? d - (__rxBuffer__ + __rxHead__) : __rxTail__ - __rxHead__;
+        s.concat (__rxBuffer__ + __rxHead__, l);
+        __rxHead__ += l;
+        if (d) { __rxHead__ ++; return true; }
+      }
+      return false;
+    }
+
+    bool readLine (String& line)              { // reads a line ending with \n or \r\n (line ending is not included), returns false indicating error or closed connection
+      line = "";
+      if (!readUntil (line, '\n')) return false;
+      if (line.length () && line [line.length () - 1] == '\r') line.remove (line.length () - 1);
+      return true;
+    }
+
+  private:
+
+    int __recvFromSocket__ (char *buffer, int bufferSize)             // recvData without receive buffer
+    {
       while (true) {
         yield ();
         if (__socket__ == -1) return 0;
         switch (int recvTotal = recv (__socket__, buffer, bufferSize, 0)) {
           case -1:
             // Serial.printf ("recvData errno: %i timeout: %i\n", errno, millis () - __lastActiveMillis__);
-            #define EAGAIN 11
-            #define ENAVAIL 119
-            if (errno == EAGAIN || errno == ENAVAIL) {
-              if ((__timeOutMillis__ == TcpConnection::INFINITE) || (millis () - __lastActiveMillis__ < __timeOutMillis__)) { // non-blocking -----
-                delay (1);
-                break;
-              }
+            if (errno == EAGAIN || errno == EINPROGRESS) {
+              if (__waitForSocket__ (false)) break; // block until data arrives or time-out expires
             }
             // else close and continue to case 0
             // Serial.printf ("[%s] TcpConnection time-out\n", __func__);
@@ -227,12 +280,15 @@ class TcpConnection {
             return 0;
           default:
             __lastActiveMillis__ = millis ();
+            __bytesReceived__ += recvTotal;
             // log_i ("[Thread:%lu][Core:%i][Socket:%i] recvData: %i bytes\n", (unsigned long) xTaskGetCurrentTaskHandle (), xPortGetCoreID (), __socket__, recvTotal);
             return recvTotal;
         }
       }
     }
 
+  public:
+
     // define available data types
     enum AVAILABLE_TYPE {
       NOT_AVAILABLE = 0,  // no data is available to be read
@@ -240,9 +296,9 @@ class TcpConnection {
       ERROR = 3           // error in communication
     };
     AVAILABLE_TYPE available ()               { // checks if incoming data is pending to be read
+      if (__rxHead__ < __rxTail__) return TcpConnection::AVAILABLE;
       char buffer;
       if (-1 == recv (__socket__, &buffer, sizeof (buffer), MSG_PEEK)) {
-        #define EAGAIN 11
         if (errno == EAGAIN || errno == EBADF) {
           if ((__timeOutMillis__ != TcpConnection::INFINITE) && (millis () - __lastActiveMillis__ >= __timeOutMillis__)) {
             // Serial.printf ("[%s] TcpConnection time-out\n", __func__);
@@ -265,7 +321,6 @@ class TcpConnection {
     {
       // Serial.printf ("sendData (%lu, %i)\n", (unsigned long) buffer, bufferSize);
       int writtenTotal = 0;
-      #define min(a,b) ((a)<(b)?(a):(b))
       while (bufferSize) {
         yield ();
         if (__socket__ == -1) return writtenTotal;
@@ -273,13 +328,8 @@ class TcpConnection {
         switch (int written = send (__socket__, buffer, bufferSize, 0)) { // seems like ESP32 can send even larger packets
           case -1:
             // Serial.printf ("sendData errno: %i timeout: %i\n", errno, millis () - __lastActiveMillis__);
-            #define EAGAIN 11
-            #define ENAVAIL 119
-            if (errno == EAGAIN || errno == ENAVAIL) {
-              if ((__timeOutMillis__ == TcpConnection::INFINITE) || (millis () - __lastActiveMillis__ < __timeOutMillis__)) {
-                delay (1);
-                break;
-              }
+            if (errno == EAGAIN || errno == EINPROGRESS) {
+              if (__waitForSocket__ (true)) break; // block until there is room in TCP send buffer or time-out expires
             }
             // else close and continue to case 0
             // Serial.printf ("[%s] TcpConnection time-out\n", __func__);
@@ -290,6 +340,7 @@ class TcpConnection {
             return writtenTotal;
           default:
             writtenTotal += written;
+            __bytesSent__ += written;
             buffer += written;
             bufferSize -= written;
             __lastActiveMillis__ = millis ();
@@ -300,6 +351,49 @@ class TcpConnection {
       return writtenTotal;
     }
 
+    virtual int sendData (struct iovec *segments, int segmentCount)      // scatter-gather variant: sends all the segments one after another (without copying them together first), returns the number of bytes actually sent or 0 indicatig error or closed connection
+    {                                                                     // (segments array gets modified while sending)
+      int writtenTotal = 0;
+      while (segmentCount) {
+        if (!segments->iov_len) { segments ++; segmentCount --; continue; } // skip empty (or already sent) segments
+        yield ();
+        if (__socket__ == -1) return writtenTotal;
+        switch (int written = writev (__socket__, segments, segmentCount)) {
+          case -1:
+            if (errno == EAGAIN || errno == EINPROGRESS) {
+              if (__waitForSocket__ (true)) break; // block until there is room in TCP send buffer or time-out expires
+            }
+            // else close and continue to case 0
+            __timeOut__ = true;
+            closeConnection ();
+          case 0:   // socket is already closed
+            return writtenTotal;
+          default:
+            writtenTotal += written;
+            __bytesSent__ += written;
+            __skipSentSegments__ (segments, segmentCount, written);
+            __lastActiveMillis__ = millis ();
+            break;
+        }
+      }
+      return writtenTotal;
+    }
+
+    virtual int trySendData (struct iovec *segments, int segmentCount)   // sends only as much of the segments as fits into TCP send buffer right away, without waiting, returns the number of bytes actually sent (0 if TCP send buffer is full) or -1 indicatig error or closed connection
+    {                                                                     // (segments array gets modified the same way as with sendData, so the rest can be sent later) - this lets the caller do something useful, like reading the next block of a file, while lwIP is transmitting 
+      if (__socket__ == -1) return -1;
+      int written = writev (__socket__, segments, segmentCount);
+      if (written == -1) {
+        if (errno == EAGAIN || errno == EINPROGRESS) return 0;
+        closeConnection ();
+        return -1;
+      }
+      __bytesSent__ += written;
+      __skipSentSegments__ (segments, segmentCount, written);
+      __lastActiveMillis__ = millis ();
+      return written;
+    }
+
     virtual int sendData (char string []) { return (sendData (string, strlen (string))); }
     
     virtual int sendData (String string) { return (sendData ((char *) string.c_str (), strlen (string.c_str ()))); }
@@ -318,7 +412,18 @@ class TcpConnection {
 
     unsigned long getTimeOut ()               { return __timeOutMillis__; } // returns time-out milliseconds
 
+    unsigned long getWakeUps ()               { return __wakeUps__; } // returns how many times recvData or sendData had to wait for the socket - useful to see how much CPU an idle connection costs
+
+    unsigned long getBytesSent ()             { return __bytesSent__; } // returns the number of bytes sent through this connection so far
+
+    unsigned long getBytesReceived ()         { return __bytesReceived__; } // returns the number of bytes received through this connection so far
+
+    void *getConnectionContext ()             { return __connectionContext__; } // per-connection state of reactor connection handler
+
+    void setConnectionContext (void *connectionContext) { __connectionContext__ = connectionContext; }
+
   private:
+    friend class TcpServer;
 
     void (* __connectionHandlerCallback__) (TcpConnection *, void *) = NULL;  // local copy of constructor parameters
     void *__connectionHandlerCallbackParamater__ = NULL;
@@ -329,6 +434,86 @@ class TcpConnection {
     unsigned long __lastActiveMillis__ = millis ();                   // needed for time-out detection
     bool __timeOut__ = false;                                         // "time-out" flag
     char __thisSideIP__ [16] = {};                                    // if this is a server socket then this is going to be a server IP, if this is a client socket then this is going to be client IP
+    void *__connectionContext__ = NULL;                               // in reactor mode connection handler keeps its state here instead of on its own stack
+    unsigned long __wakeUps__ = 0;                                    // how many times recvData or sendData waited for the socket
+    unsigned long __bytesSent__ = 0;
+    unsigned long __bytesReceived__ = 0;
+
+    TcpConnection **__connectionList__ = NULL;                        // TcpServer keeps its threaded and reactor connections in a list (see TcpServer::stop), NULL if this connection is not in one
+    TcpConnection *__nextConnection__ = NULL;
+    TcpConnection *__previousConnection__ = NULL;
+    bool __shutDown__ = false;                                        // TcpServer::stop has already shut the socket down
+    bool __shutDownInProgress__ = false;                              // TcpServer::stop is calling shutdown () on the socket, closeConnection waits before closing it
+
+    void __linkTo__ (TcpConnection **connectionList) {                // adds this connection to TcpServer's list
+      portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+        __connectionList__ = connectionList;
+        __previousConnection__ = NULL;
+        if ((__nextConnection__ = *connectionList)) __nextConnection__->__previousConnection__ = this;
+        *connectionList = this;
+      portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+    }
+
+    void __unlink__ () {                                              // removes this connection from TcpServer's list if it is in one
+      portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+        if (__connectionList__) {
+          if (__previousConnection__) __previousConnection__->__nextConnection__ = __nextConnection__; else *__connectionList__ = __nextConnection__;
+          if (__nextConnection__) __nextConnection__->__previousConnection__ = __previousConnection__;
+          __connectionList__ = NULL;
+        }
+      portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+    }
+
+    bool __startThread__ (unsigned int stackSize) {                   // starts connection handler thread, returns false if it couldn't be started - when it could the thread owns the instance (and deletes it when it finishes) so the caller may not use it any more
+      __connectionState__ = TcpConnection::RUNNING;
+      #define tskNORMAL_PRIORITY 1
+      if (pdPASS == xTaskCreate (__connectionHandler__,
+                                 "TcpConnection",
+                                 stackSize,
+                                 this, // pass "this" pointer to static member function
+                                 tskNORMAL_PRIORITY,
+                                 NULL)) return true;
+      __connectionState__ = TcpConnection::NOT_STARTED;
+      // log_e ("[Thread:%lu][Core:%i][Socket:%i] xTaskCreate () error\n", (unsigned long) xTaskGetCurrentTaskHandle (), xPortGetCoreID (), __socket__);
+      return false;
+    }
+
+    char *__rxBuffer__ = NULL;                                        // receive buffer for readLine, readUntil, readExactly and peek
+    int __rxHead__ = 0;                                               // next byte to be read from receive buffer
+    int __rxTail__ = 0;                                               // end of valid data in receive buffer
+
+    bool __fillRxBuffer__ () {                                        // makes sure there is at least 1 byte waiting in receive buffer, returns false indicating error or closed connection
+      if (__rxHead__ < __rxTail__) return true;
+      if (!__rxBuffer__ && !(__rxBuffer__ = (char *) malloc (TCP_CONNECTION_RX_BUFFER_SIZE))) return false;
+      __rxHead__ = 0;
+      __rxTail__ = __recvFromSocket__ (__rxBuffer__, TCP_CONNECTION_RX_BUFFER_SIZE);
+      return __rxTail__ > 0;
+    }
+
+    static void __skipSentSegments__ (struct iovec *&segments, int& segmentCount, int written) { // advances segments past what writev has already sent
+      while (written) {
+        if ((size_t) written >= segments->iov_len) { written -= segments->iov_len; segments->iov_len = 0; segments ++; segmentCount --; }
+        else { segments->iov_base = (char *) segments->iov_base + written; segments->iov_len -= written; written = 0; }
+      }
+    }
+
+    bool __waitForSocket__ (bool forWriting) {                        // blocks until socket gets readable (writable), time-out expires or 100 ms pass, returns false if time-out has already expired
+      unsigned long waitMillis = 100; // don't wait longer than 100 ms at once so the connection notices if it gets closed from another thread (closeConnection, server unloading)
+      if (__timeOutMillis__ != TcpConnection::INFINITE) {
+        unsigned long activeMillis = millis () - __lastActiveMillis__;
+        if (activeMillis >= __timeOutMillis__) return false;
+        if (__timeOutMillis__ - activeMillis < waitMillis) waitMillis = __timeOutMillis__ - activeMillis;
+      }
+      int s = __socket__; // take a local copy, closeConnection may be called from another thread
+      if (s == -1) return true; // caller will find out the connection is closed
+      fd_set fds;
+      FD_ZERO (&fds);
+      FD_SET (s, &fds);
+      struct timeval timeout = {(long) (waitMillis / 1000), (long) ((waitMillis % 1000) * 1000)};
+      select (s + 1, forWriting ? NULL : &fds, forWriting ? &fds : NULL, NULL, &timeout); // instead of polling with delay (1) let lwIP wake us up when something happens
+      __wakeUps__ ++;
+      return true;
+    }
 
     enum CONNECTION_THREAD_STATE_TYPE {
       NOT_STARTED = 9,                                                // initial state
@@ -356,45 +541,100 @@ class TcpConnection {
 };
 
 
-// TcpServer can be used in two different modes:
+// TcpServer can be used in three different modes:
 // - threaded TcpServer starts new thread that listens for incomming connection and creates a threaded TcpConnection instance for each of them
 //    successful listener thread creation can be tested using started () member function - result is available immediately after constructor returns
 //    TO DO: make constructor return NULL in unsuccessful
+// - reactor TcpServer (threaded constructor with connectionEventCallback) starts only one thread that accepts connections and waits on all of them with select (),
+//    connectionEventCallback is called each time data arrives on a connection and once more after the connection is closed, so it can free its context,
+//    the connection costs only TcpConnection instance instead of a thread with its own stack
 // - non-threaded TcpServer starts new thread that accepts only one connection and creates a non-threaded TcpConnection instance for it
 //    successful listener thread creation can be tested using started () member function - result is available immediately after constructor returns
 //    when connection arrives connection () memmber funcion will hold a reference to it is not likely to happen when constructor returns,
 //    calling program should test connection () to NULL value until connection () or timeOut () occur
 //    TO DO: make constructor return NULL in unsuccessful
 
+#ifndef TCP_SERVER_REACTOR_MAX_CONNECTIONS
+  #define TCP_SERVER_REACTOR_MAX_CONNECTIONS 8 // max number of simultaneous connections one reactor thread handles (lwIP has only 10 sockets by default)
+#endif
+#ifndef TCP_SERVER_RATE_LIMIT_CLIENTS
+  #define TCP_SERVER_RATE_LIMIT_CLIENTS 16 // how many client IPs rate limiting remembers (see setRateLimit), the least recently seen ones are forgotten first
+#endif
+#define __TCP_SERVER_RATE_LIMIT_WAYS__ 4   // a client IP can only be in one of 4 consecutive slots, so looking it up never checks more than 4 slots
+#if TCP_SERVER_RATE_LIMIT_CLIENTS < __TCP_SERVER_RATE_LIMIT_WAYS__
+  #error "TCP_SERVER_RATE_LIMIT_CLIENTS must be at least 4"
+#endif
+
 class TcpServer {                                                 // threaded TCP server
 
   public:
 
+    // define what reactor should do with the connection after connectionEventCallback returns
+    enum CONNECTION_EVENT_RESULT_TYPE {
+      KEEP_CONNECTION = 0,                                          // wait for more data on this connection
+      CLOSE_CONNECTION = 1,                                         // close the connection
+      RELEASE_CONNECTION = 2                                        // connectionEventCallback took the connection over (and must delete it itself), reactor should forget about it
+    };
+
+    // define what worker pool should do with a new connection when all the workers are busy and accept queue is full
+    enum OVERFLOW_POLICY_TYPE {
+      WAIT_FOR_WORKER = 0,                                          // stop accepting until a worker gets free (new connections wait in TCP backlog)
+      REJECT_WHEN_BUSY = 1,                                         // let the server send its "busy" reply (see __rejectConnection__) and close the connection
+      CLOSE_WHEN_BUSY = 2                                           // just close the connection
+    };
+
     // constructor of a threaded TCP server
     TcpServer      (void (* connectionHandlerCallback) (TcpConnection *, void *), // a reference to callback function that will handle the connection
-                    void *connectionHandlerCallbackParameter,             // a reference to parameter that will be passed to connectionHandlerCallback
+                    void *connectionHandlerCallbackParameter,             // a reference to parameter that will be passed to connectionHandlerCallback (or connectionEventCallback)
                     unsigned int connectionStackSize,                     // stack size of a thread where connection runs - this value depends on what server really does (see connectionHandler function) should be set appropriately (not to use too much memory and not to crush ESP)
                     unsigned long timeOutMillis,                          // connection time-out in milli seconds
                     char *serverIP,                                       // server IP address, 0.0.0.0 for all available IP addresses - 15 characters at most!
                     int serverPort,                                       // server port
-                    bool (* firewallCallback) (char *)                    // a reference to callback function that will be celled when new connection arrives
+                    bool (* firewallCallback) (char *),                   // a reference to callback function that will be celled when new connection arrives
+                    CONNECTION_EVENT_RESULT_TYPE (* connectionEventCallback) (TcpConnection *, void *) = NULL, // if set the server runs as a reactor: all connections are handled by one thread (with connectionStackSize stack) that calls connectionEventCallback when data arrives
+                    unsigned int workerPoolSize = 0,                      // if > 0 connections are handled by this many pre-started worker threads (each with connectionStackSize stack) instead of a new thread for each connection
+                    unsigned int acceptQueueLength = 8,                   // how many accepted connections may wait for a free worker
+                    OVERFLOW_POLICY_TYPE overflowPolicy = TcpServer::WAIT_FOR_WORKER // what to do with new connection when accept queue is full
                    )                          {
       // log_v ("[Thread:%lu][Core:%i] threaded constructor {\n", (unsigned long) xTaskGetCurrentTaskHandle (), xPortGetCoreID ());
       // copy constructor parameters to local structure
-      __connectionHandlerCallback__ = connectionHandlerCallback;
+      __connectionHandlerCallback__ = connectionEventCallback ? NULL : connectionHandlerCallback;
+      __connectionEventCallback__ = connectionEventCallback;
       __connectionHandlerCallbackParameter__ = connectionHandlerCallbackParameter;
       __connectionStackSize__ = connectionStackSize;
       __timeOutMillis__ = timeOutMillis;
       strcpy (__serverIP__, serverIP);
       __serverPort__ = serverPort;
       __firewallCallback__ = firewallCallback;
+      __overflowPolicy__ = overflowPolicy;
+
+      // start worker threads (worker pool mode)
+#define tskNORMAL_PRIORITY 1
+      if (workerPoolSize && __connectionHandlerCallback__) {
+        if ((__acceptQueue__ = xQueueCreate (acceptQueueLength ? acceptQueueLength : 1, sizeof (__acceptedConnectionType__))) && (__workerConnection__ = (TcpConnection **) calloc (workerPoolSize, sizeof (TcpConnection *)))) {
+          __workerPoolSize__ = workerPoolSize;
+          for (unsigned int i = 0; i < workerPoolSize; i++) {
+            portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+              __runningWorkers__ ++;
+            portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+            if (pdPASS != xTaskCreate (__worker__, "TcpWorker", connectionStackSize, this, tskNORMAL_PRIORITY, NULL)) {
+              portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+                __runningWorkers__ --;
+              portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+            }
+          }
+        }
+        if (!__runningWorkers__) { // fall back to a thread per connection
+          TcpDmesg ("[TcpServer] couldn't start worker pool, using a thread for each connection.");
+          __workerPoolSize__ = 0;
+        }
+      }
 
       // start listener thread
       __listenerState__ = TcpServer::NOT_RUNNING;
-#define tskNORMAL_PRIORITY 1
       if (pdPASS != xTaskCreate (__listener__,
-                                 "TcpListener",
-                                 2048, // 2 KB stack is large enough for TCP listener
+                                 __reactorMode__ () ? "TcpReactor" : "TcpListener",
+                                 __reactorMode__ () ? connectionStackSize : 2048, // 2 KB stack is large enough for TCP listener but reactor also runs connectionEventCallback
                                  this, // pass "this" pointer to static member function
                                  tskNORMAL_PRIORITY,
                                  NULL)) {
@@ -435,9 +675,8 @@ class TcpServer {                                                 // threaded TC
 
     virtual ~TcpServer ()                     {
       // log_v ("[Thread:%lu] destructor {\n", (unsigned long) xTaskGetCurrentTaskHandle (), xPortGetCoreID ());
-      if (__connection__) delete (__connection__); // close non-threaded mode connection if it has been established
-      __instanceUnloading__ = true; // signal __listener__ to stop
-      while (__listenerState__ < TcpServer::FINISHED) delay (1); // wait for __listener__ to finish before releasing the memory occupied by this instance
+      stop (); // derived servers should have already called it, before they released what their connections use
+      if (__workerConnection__) free (__workerConnection__);
       // log_v ("[Thread:%lu][Core:%i] } destructor\n", (unsigned long) xTaskGetCurrentTaskHandle (), xPortGetCoreID ());
     }
 
@@ -467,12 +706,90 @@ class TcpServer {                                                 // threaded TC
       return (__listenerState__ == TcpServer::ACCEPTING_CONNECTIONS);
     }
 
+    // Rate limiting: each client IP gets a bucket of burst tokens that refills with tokensPerSecond tokens per second. Each new connection
+    // takes a token (httpServer also takes one for each further request on a persistent connection). A client whose bucket is empty gets
+    // rejected right after accept - httpServer replies with 429 Too many requests, the other servers just close the connection - so one
+    // client polling in a tight loop can't use up all the threads and memory. Buckets are kept for TCP_SERVER_RATE_LIMIT_CLIENTS clients.
+    void setRateLimit (float tokensPerSecond, unsigned int burst = 10) { // tokensPerSecond = 0 turns rate limiting off (default)
+      portENTER_CRITICAL (&__csRateLimit__);
+        __rateLimitTokensPerSecond__ = tokensPerSecond;
+        __rateLimitBurst__ = burst ? burst : 1;
+        memset (__rateLimitBucket__, 0, sizeof (__rateLimitBucket__)); // start with full buckets
+      portEXIT_CRITICAL (&__csRateLimit__);
+    }
+
+    unsigned long getRateLimitRejections ()   { // returns the number of connections (and HTTP requests) rejected by rate limiting
+      portENTER_CRITICAL (&__csRateLimit__);
+        unsigned long r = __rateLimitRejections__;
+      portEXIT_CRITICAL (&__csRateLimit__);
+      return r;
+    }
+
+  protected:
+
+    // Stops the server: stops accepting new connections, closes the connections that are still opened and waits until listener (reactor),
+    // workers, connection threads and the threads that reactor connections have been released to finish. Destructors of derived servers 
+    // call it first, before they free what their connection handlers use. It may be called more than once.
+    void stop ()                              {
+      if (__connection__) { delete (__connection__); __connection__ = NULL; } // close non-threaded mode connection if it has been established
+      __instanceUnloading__ = true; // signal __listener__ (and workers) to stop
+      while (__listenerState__ < TcpServer::FINISHED) delay (1); // wait for __listener__ to finish - reactor closes its connections before it finishes
+      if (__acceptQueue__) { // worker pool mode: close connections workers are handling, wait for workers to finish and close connections still waiting in accept queue
+        while (__runningWorkers__) {
+          __shutDownType__ connection [8];
+          int n = 0;
+          portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+            for (unsigned int i = 0; i < __workerPoolSize__ && n < 8; i++) if (__workerConnection__ [i] && __beginShutDown__ (__workerConnection__ [i], &connection [n])) n ++;
+          portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+          __finishShutDown__ (connection, n); // worker will close the connection itself
+          delay (1);
+        }
+        __acceptedConnectionType__ acceptedConnection;
+        while (pdPASS == xQueueReceive (__acceptQueue__, &acceptedConnection, 0)) close (acceptedConnection.socket);
+        vQueueDelete (__acceptQueue__);
+        __acceptQueue__ = NULL;
+      }
+      while (true) { // threaded mode connections and reactor connections released to threads of their own: shut their sockets down (each once) and wait until their threads delete them
+        __shutDownType__ connection [8];
+        int n = 0;
+        portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+          bool finished = !__connectionList__;
+          for (TcpConnection *c = __connectionList__; c && n < 8; c = c->__nextConnection__) if (__beginShutDown__ (c, &connection [n])) n ++;
+        portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+        if (finished) break;
+        __finishShutDown__ (connection, n); // the thread will close the connection itself
+        if (!n) delay (1);
+      }
+    }
+
   private:
     friend class telnetServer;
     friend class ftpServer;
     friend class httpServer;
 
+    // shutdown () is a lwIP call and may not be made inside a critical section, so stop () marks the connections inside it and shuts them down after it
+    struct __shutDownType__ {
+      TcpConnection *connection;
+      int socket;
+    };
+
+    static bool __beginShutDown__ (TcpConnection *c, __shutDownType__ *s) { // call inside csTcpConnectionInternalStructure, returns false if the connection doesn't need to be shut down (again)
+      if (c->__shutDown__ || c->__socket__ < 0) return false;
+      c->__shutDown__ = true;
+      c->__shutDownInProgress__ = true; // until __finishShutDown__ closeConnection doesn't close the socket, and the connection (its destructor calls closeConnection) doesn't go away
+      *s = {c, c->__socket__};
+      return true;
+    }
+
+    static void __finishShutDown__ (__shutDownType__ *s, int n) { // call outside of critical section
+      for (int i = 0; i < n; i++) shutdown (s [i].socket, SHUT_RDWR);
+      portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+        for (int i = 0; i < n; i++) s [i].connection->__shutDownInProgress__ = false;
+      portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+    }
+
     void (* __connectionHandlerCallback__) (TcpConnection *, void *) = NULL; // local copy of constructor parameters
+    CONNECTION_EVENT_RESULT_TYPE (* __connectionEventCallback__) (TcpConnection *, void *) = NULL;
     void *__connectionHandlerCallbackParameter__ = NULL;
     unsigned int __connectionStackSize__;
     unsigned long __timeOutMillis__;
@@ -481,6 +798,19 @@ class TcpServer {                                                 // threaded TC
     bool (* __firewallCallback__) (char *IP);
 
     TcpConnection *__connection__ = NULL;                           // pointer to TcpConnection instance (non-threaded mode only)
+    TcpConnection *__reactorConnection__ [TCP_SERVER_REACTOR_MAX_CONNECTIONS] = {}; // connections handled by reactor thread (reactor mode only)
+    TcpConnection *__connectionList__ = NULL;                       // threaded mode and reactor connections that haven't been deleted yet, see stop ()
+
+    struct __acceptedConnectionType__ {                             // accepted connection waiting in accept queue for a free worker (worker pool mode only)
+      int socket;
+      char clientIP [16];
+    };
+    QueueHandle_t __acceptQueue__ = NULL;                           // accepted connections waiting for a free worker (worker pool mode only)
+    unsigned int __workerPoolSize__ = 0;
+    unsigned int __runningWorkers__ = 0;
+    unsigned int __startedWorkers__ = 0;
+    TcpConnection **__workerConnection__ = NULL;                    // connections workers are handling at the moment, so the destructor can close them
+    OVERFLOW_POLICY_TYPE __overflowPolicy__ = WAIT_FOR_WORKER;
     enum LISTENER_STATE_TYPE {
       NOT_RUNNING = 9,                                              // initial state
       RUNNING = 1,                                                  // preparing listening socket to start accepting connections
@@ -494,29 +824,98 @@ class TcpServer {                                                 // threaded TC
     unsigned long __lastActiveMillis__ = millis ();                 // used for time-out detection in non-threaded mode
     bool __timeOut__ = false;                                       // used to report time-out
 
+    unsigned long __connectionTimeOutMillis__ () { // time-out for new connections, derived servers may change it while the server is running (see httpServer::setKeepAlive)
+      portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+        unsigned long t = __timeOutMillis__;
+      portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+      return t;
+    }
+
     bool __threadedMode__ ()                  {
-      return (__connectionHandlerCallback__ != NULL);  // returns true if server is working in threaded mode
+      return (__connectionHandlerCallback__ != NULL || __connectionEventCallback__ != NULL);  // returns true if server is working in threaded (or reactor) mode
+    }
+
+    bool __reactorMode__ ()                   {
+      return (__connectionEventCallback__ != NULL);  // returns true if server is working in reactor mode
     }
 
     bool __callFirewallCallback__ (char *IP)  {
       return __firewallCallback__ ? __firewallCallback__ (IP) : true;  // calls firewall function
     }
 
+    struct __rateLimitBucketType__ {                                // token bucket of one client IP
+      uint32_t ip;                                                  // 0 - free slot
+      float tokens;
+      unsigned long lastMillis;                                     // when tokens were last counted, also tells which client has been seen least recently
+    };
+    __rateLimitBucketType__ __rateLimitBucket__ [TCP_SERVER_RATE_LIMIT_CLIENTS] = {};
+    float __rateLimitTokensPerSecond__ = 0;                         // 0 - no rate limiting
+    float __rateLimitBurst__ = 10;
+    unsigned long __rateLimitRejections__ = 0;
+    portMUX_TYPE __csRateLimit__ = portMUX_INITIALIZER_UNLOCKED;
+
+    bool __admitClient__ (uint32_t ip)        { // takes a token from client's bucket, returns false if the bucket is empty and the client should be rejected
+      uint32_t h = ip ^ (ip >> 16); h *= 0x45d9f3b; h ^= h >> 16; // mix all 4 bytes, clients on the same network only differ in the last one
+      int first = h % TCP_SERVER_RATE_LIMIT_CLIENTS;
+      unsigned long now = millis ();
+      bool admitted;
+      portENTER_CRITICAL (&__csRateLimit__);
+        float tokensPerSecond = __rateLimitTokensPerSecond__; // setRateLimit may change both at any time, the bucket must be refilled with a matching pair
+        float burst = __rateLimitBurst__;
+        if (tokensPerSecond <= 0) { portEXIT_CRITICAL (&__csRateLimit__); return true; }
+        __rateLimitBucketType__ *b = NULL;
+        for (int w = 0; w < __TCP_SERVER_RATE_LIMIT_WAYS__; w++) { // find client's bucket or the least recently used one of the slots it may occupy
+          __rateLimitBucketType__ *c = &__rateLimitBucket__ [(first + w) % TCP_SERVER_RATE_LIMIT_CLIENTS];
+          if (c->ip == ip) { b = c; break; }
+          if (!b || (b->ip && (!c->ip || now - c->lastMillis > now - b->lastMillis))) b = c;
+        }
+        if (b->ip != ip) { b->ip = ip; b->tokens = burst; } // new client (maybe in place of a forgotten one) starts with a full bucket
+        else {
+          b->tokens += (float) (now - b->lastMillis) * tokensPerSecond / 1000;
+          if (b->tokens > burst) b->tokens = burst;
+        }
+        b->lastMillis = now;
+        if ((admitted = b->tokens >= 1)) b->tokens -= 1;
+        else __rateLimitRejections__ ++;
+      portEXIT_CRITICAL (&__csRateLimit__);
+      return admitted;
+    }
+
     virtual void __newConnection__ (int connectionSocket, char *clientIP)   // creates new TcpConnection instance for connectionSocket
     {
       TcpConnection *newConnection;
-      if (__threadedMode__ ()) { // in threaded mode we pass connectionHandler address to TcpConnection instance
-        newConnection = new TcpConnection (__connectionHandlerCallback__, __connectionHandlerCallbackParameter__, __connectionStackSize__, connectionSocket, clientIP, __timeOutMillis__);
-        if (newConnection) {
-          if (!newConnection->started ()) {
-            delete (newConnection); // also closes the connection
+      if (__reactorMode__ ()) { // in reactor mode create non-threaded TcpConnection instance and put it among the connections reactor is waiting on
+        for (int i = 0; i < TCP_SERVER_REACTOR_MAX_CONNECTIONS; i++) {
+          if (!__reactorConnection__ [i]) {
+            if (!(__reactorConnection__ [i] = new TcpConnection (connectionSocket, clientIP, __connectionTimeOutMillis__ ()))) close (connectionSocket);
+            else __reactorConnection__ [i]->__linkTo__ (&__connectionList__); // so that stop () can still find it if connectionEventCallback releases it to a thread of its own
+            return;
           }
+        }
+        TcpDmesg ("[TcpServer] reactor has no free connection slot, rejecting connection from " + String (clientIP) + ".");
+        close (connectionSocket);
+      } else if (__workerPoolSize__) { // in worker pool mode pass the socket to one of already running workers through accept queue
+        __acceptedConnectionType__ acceptedConnection = {connectionSocket};
+        strcpy (acceptedConnection.clientIP, clientIP);
+        if (__overflowPolicy__ == TcpServer::WAIT_FOR_WORKER) {
+          while (pdPASS != xQueueSend (__acceptQueue__, &acceptedConnection, pdMS_TO_TICKS (100))) if (__instanceUnloading__) { close (connectionSocket); return; }
+        } else if (pdPASS != xQueueSend (__acceptQueue__, &acceptedConnection, 0)) {
+          if (__overflowPolicy__ == TcpServer::REJECT_WHEN_BUSY) __rejectConnection__ (connectionSocket);
+          close (connectionSocket);
+        }
+      } else if (__connectionHandlerCallback__) { // in threaded mode we pass connectionHandler address to TcpConnection instance
+        newConnection = new TcpConnection (connectionSocket, clientIP, __connectionTimeOutMillis__ ());
+        if (newConnection) {
+          newConnection->__connectionHandlerCallback__ = __connectionHandlerCallback__;
+          newConnection->__connectionHandlerCallbackParamater__ = __connectionHandlerCallbackParameter__;
+          newConnection->__linkTo__ (&__connectionList__); // before its thread starts, so that stop () can find it
+          if (!newConnection->__startThread__ (__connectionStackSize__)) delete (newConnection); // also closes the connection - once the thread has started it deletes the instance when it finishes, so newConnection may not be used any more
         } else {
           // log_e ("[Thread:%lu][Core:%i][Socket:%i] new () error\n", (unsigned long) xTaskGetCurrentTaskHandle (), xPortGetCoreID (), connectionSocket);
           close (connectionSocket); // close the connection
         }
       } else { // in non-threaded mode create non-threaded TcpConnection instance
-        newConnection = new TcpConnection (connectionSocket, clientIP, __timeOutMillis__);
+        newConnection = new TcpConnection (connectionSocket, clientIP, __connectionTimeOutMillis__ ());
         __connection__ = newConnection; // in not-threaded mode calling program will need reference to a connection
       }
     }
@@ -570,6 +969,12 @@ class TcpServer {                                                 // threaded TC
         }
         // log_i ("[Thread:%lu][Core:%i] __listener__: started accepting connections on %s : %i\n", (unsigned long) xTaskGetCurrentTaskHandle (), xPortGetCoreID (), ths->getServerIP (), ths->getServerPort ());
 
+        if (ths->__reactorMode__ ()) { // reactor handles incomming connections and data on all of them in this thread
+          ths->__listenerState__ = TcpServer::ACCEPTING_CONNECTIONS;
+          ths->__reactor__ (listenerSocket);
+          goto terminateListener;
+        }
+
         while (!ths->__instanceUnloading__) { // handle incomming connections
           delay (1);
           if (!ths->__threadedMode__ ()) { // checing time-out makes sense only when working as non-threaded TCP server
@@ -595,6 +1000,11 @@ class TcpServer {                                                 // threaded TC
               close (connectionSocket);
               continue;
             }
+            if (!ths->__admitClient__ (connectingAddress.sin_addr.s_addr)) { // the client has exceeded its rate limit
+              ths->__rejectRateLimitedConnection__ (connectionSocket);
+              close (connectionSocket);
+              continue;
+            }
             ths->__newConnection__ (connectionSocket, (char *) __inet_ntos__ (connectingAddress.sin_addr).c_str ());
             if (!ths->__threadedMode__ ()) goto terminateListener; // in non-threaded mode server only accepts one connection
           } // new connection
@@ -608,6 +1018,100 @@ terminateListener:
       vTaskDelete (NULL); // terminate this thread
     }
 
+    virtual void __rejectConnection__ (int connectionSocket) {}    // derived servers may send "server is busy" reply here before the connection gets closed
+
+    virtual void __rejectRateLimitedConnection__ (int connectionSocket) {} // derived servers may send "too many requests" reply here before the connection gets closed
+
+    static void __worker__ (void *taskParameters) {                 // worker running in its own thread, takes accepted connections from accept queue (worker pool mode only)
+      TcpServer *ths = (TcpServer *) taskParameters; // this is how you pass "this" pointer to static memeber function
+      unsigned int workerIndex;
+      portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+        workerIndex = ths->__startedWorkers__ ++; // each worker gets its own slot in __workerConnection__
+      portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+      __acceptedConnectionType__ acceptedConnection;
+      while (!ths->__instanceUnloading__) {
+        if (pdPASS != xQueueReceive (ths->__acceptQueue__, &acceptedConnection, pdMS_TO_TICKS (100))) continue; // check __instanceUnloading__ flag at least 10 times per second
+        TcpConnection connection (acceptedConnection.socket, acceptedConnection.clientIP, ths->__connectionTimeOutMillis__ ()); // non-threaded TcpConnection lives on worker's stack, no heap is needed
+        portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+          ths->__workerConnection__ [workerIndex] = &connection;
+        portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+        ths->__connectionHandlerCallback__ (&connection, ths->__connectionHandlerCallbackParameter__);
+        portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+          ths->__workerConnection__ [workerIndex] = NULL;
+        portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+      } // TcpConnection destructor closes the connection at the end of each loop
+      portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+        ths->__runningWorkers__ --;
+      portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+      vTaskDelete (NULL);
+    }
+
+    void __closeReactorConnection__ (int i) { // closes i-th reactor connection, lets connectionEventCallback free its context and unloads TcpConnection instance
+      TcpConnection *connection = __reactorConnection__ [i];
+      __reactorConnection__ [i] = NULL;
+      connection->closeConnection ();
+      if (__connectionEventCallback__ (connection, __connectionHandlerCallbackParameter__) != TcpServer::RELEASE_CONNECTION) delete (connection);
+    }
+
+    void __reactor__ (int listenerSocket) { // waits on listener socket and all connection sockets at the same time and dispatches events (reactor mode only)
+      while (!__instanceUnloading__) {
+        fd_set readSet;
+        FD_ZERO (&readSet);
+        FD_SET (listenerSocket, &readSet);
+        int maxSocket = listenerSocket;
+        for (int i = 0; i < TCP_SERVER_REACTOR_MAX_CONNECTIONS; i++) {
+          TcpConnection *connection = __reactorConnection__ [i];
+          if (!connection) continue;
+          if (connection->isOpened () && connection->__timeOutMillis__ != TcpConnection::INFINITE && millis () - connection->__lastActiveMillis__ >= connection->__timeOutMillis__) {
+            connection->__timeOut__ = true;
+            connection->closeConnection ();
+          }
+          if (connection->isClosed ()) { __closeReactorConnection__ (i); continue; }
+          FD_SET (connection->getSocket (), &readSet);
+          if (connection->getSocket () > maxSocket) maxSocket = connection->getSocket ();
+        }
+        struct timeval timeOut = {0, 100000}; // wake up at least 10 times per second to check time-outs and __instanceUnloading__ flag
+        if (select (maxSocket + 1, &readSet, NULL, NULL, &timeOut) <= 0) continue;
+
+        // dispatch data that arrived on connections
+        for (int i = 0; i < TCP_SERVER_REACTOR_MAX_CONNECTIONS; i++) {
+          TcpConnection *connection = __reactorConnection__ [i];
+          if (!connection || connection->isClosed () || !FD_ISSET (connection->getSocket (), &readSet)) continue;
+          switch (__connectionEventCallback__ (connection, __connectionHandlerCallbackParameter__)) {
+            case TcpServer::KEEP_CONNECTION:    break;
+            case TcpServer::RELEASE_CONNECTION: __reactorConnection__ [i] = NULL; break;
+            default:                            __closeReactorConnection__ (i); break;
+          }
+        }
+
+        // accept new connections
+        if (FD_ISSET (listenerSocket, &readSet)) {
+          int connectionSocket;
+          struct sockaddr_in connectingAddress;
+          socklen_t connectingAddressSize = sizeof (connectingAddress);
+          while ((connectionSocket = accept (listenerSocket, (struct sockaddr *) &connectingAddress, &connectingAddressSize)) != -1) {
+            if (!__callFirewallCallback__ ((char *) __inet_ntos__ (connectingAddress.sin_addr).c_str ())) {
+              close (connectionSocket);
+              continue;
+            }
+            if (fcntl (connectionSocket, F_SETFL, O_NONBLOCK) == -1) {
+              close (connectionSocket);
+              continue;
+            }
+            if (!__admitClient__ (connectingAddress.sin_addr.s_addr)) { // the client has exceeded its rate limit
+              __rejectRateLimitedConnection__ (connectionSocket);
+              close (connectionSocket);
+              continue;
+            }
+            __newConnection__ (connectionSocket, (char *) __inet_ntos__ (connectingAddress.sin_addr).c_str ());
+            connectingAddressSize = sizeof (connectingAddress);
+          }
+        }
+      }
+      // instance is unloading, close all connections
+      for (int i = 0; i < TCP_SERVER_REACTOR_MAX_CONNECTIONS; i++) if (__reactorConnection__ [i]) __closeReactorConnection__ (i);
+    }
+
 };
 
 
@@ -646,7 +1150,6 @@ class TcpClient {
       serverAddress.sin_addr.s_addr = inet_addr (serverIP);
       if (connect (connectionSocket, (struct sockaddr *) &serverAddress, sizeof (serverAddress)) == -1) {
         // Serial.printf ("errno: %i\n", errno);
-#define EINPROGRESS 119
         if (errno != EINPROGRESS) {
           close (connectionSocket);
           // log_e ("[Thread:%lu][Core:%i] non-threaded constructor: connect () error %i\n", (unsigned long) xTaskGetCurrentTaskHandle (), xPortGetCoreID (), errno);
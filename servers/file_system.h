@@ -47,6 +47,43 @@
 
   bool __fileSystemMounted__ = false;
 
+  // ----- notifications about changed files, so that whoever keeps copies of files (like httpServer's file cache) can drop them -----
+
+  #ifndef FILE_SYSTEM_MAX_CHANGE_LISTENERS
+    #define FILE_SYSTEM_MAX_CHANGE_LISTENERS 4
+  #endif
+  struct __fileChangeListenerType__ {
+    void (* callback) (const char *, void *);
+    void *parameter;
+  } __fileChangeListener__ [FILE_SYSTEM_MAX_CHANGE_LISTENERS] = {};
+  portMUX_TYPE __csFileChangeListener__ = portMUX_INITIALIZER_UNLOCKED;
+
+  bool addFileChangeListener (void (* callback) (const char *fileName, void *parameter), void *parameter) { // callback will be called with full path of each file (or directory) that gets written, deleted or renamed, returns success
+    bool added = false;
+    portENTER_CRITICAL (&__csFileChangeListener__);
+      for (int i = 0; i < FILE_SYSTEM_MAX_CHANGE_LISTENERS && !added; i++) 
+        if (!__fileChangeListener__ [i].callback) { __fileChangeListener__ [i] = {callback, parameter}; added = true; }
+    portEXIT_CRITICAL (&__csFileChangeListener__);
+    if (!added) fileSystemDmesg ("[file system] too many file change listeners.");
+    return added;
+  }
+
+  void removeFileChangeListener (void (* callback) (const char *fileName, void *parameter), void *parameter) {
+    portENTER_CRITICAL (&__csFileChangeListener__);
+      for (int i = 0; i < FILE_SYSTEM_MAX_CHANGE_LISTENERS; i++) 
+        if (__fileChangeListener__ [i].callback == callback && __fileChangeListener__ [i].parameter == parameter) __fileChangeListener__ [i] = {NULL, NULL};
+    portEXIT_CRITICAL (&__csFileChangeListener__);
+  }
+
+  void fileChanged (String fileName) { // call this after a file (or directory) is written, deleted or renamed by other means than functions in this file
+    for (int i = 0; i < FILE_SYSTEM_MAX_CHANGE_LISTENERS; i++) {
+      portENTER_CRITICAL (&__csFileChangeListener__);
+        __fileChangeListenerType__ l = __fileChangeListener__ [i];
+      portEXIT_CRITICAL (&__csFileChangeListener__);
+      if (l.callback) l.callback (fileName.c_str (), l.parameter);
+    }
+  }
+
   /*
   bool mountFileSystem (bool formatIfUnformatted) {                                           // mount file system by calling this function
     fileSystemDmesg ("[file system] mounting ...");
@@ -95,6 +132,7 @@
         return false;
       }
     // xSemaphoreGive (fileSystemSemaphore);
+    fileChanged (fileName);
     return true;    
   }
 
@@ -123,6 +161,7 @@
         return false;
       }
     // xSemaphoreGive (fileSystemSemaphore);
+    fileChanged (directory);
     return true;    
   }
 
@@ -149,12 +188,12 @@
     File f = FFat.open (fileName, FILE_WRITE);
     if (f) {
       if (!f.isDirectory ()) {
-        if (f.printf (fileContent.c_str ()) == strlen (fileContent.c_str ())) {
-          f.close ();
-          return true;        
-        } else {
-          fileSystemDmesg ("[file_system] can't write " + String (fileName));
-        }
+        bool written = f.printf (fileContent.c_str ()) == strlen (fileContent.c_str ());
+        f.close ();
+        fileChanged (fileName); // the file has been truncated even if writing failed
+        if (written) return true;
+        fileSystemDmesg ("[file_system] can't write " + String (fileName));
+        return false;
       }
       f.close ();
     }    
@@ -151,19 +151,9 @@ closeFtpConnection:
       static char __readLineFromClient__ (String *line, TcpConnection *connection) {
         *line = "";
         
-        char c;
-        while (connection->recvData (&c, 1)) { // read and process incomming data in a loop 
-          switch (c) {
-              case 10:  // ignore
-                        break;
-              case 13:  // end of command line
-                        return 13;
-              default:  // fill the buffer 
-                        *line += c;
-                        break;              
-          } // switch
-        } // while
-        return false;
+        if (!connection->readUntil (*line, 13)) return false; // read the whole command line at once, Enter ends it
+        line->replace ("\n", ""); // ignore \n (the one that came after the previous line's \r)
+        return 13;
       }
 
       // ----- built-in commands -----
@@ -408,7 +398,7 @@ closeFtpConnection:
         if (fp2 == "")                                return "501 invalid directory\r\n";
         if (!userMayAccess (fp2, fsp->homeDir))       return "553 access denyed\r\n";
 
-        if (FFat.rename (fp1, fp2))                   return "250 renamed to " + s + "\r\n";
+        if (FFat.rename (fp1, fp2))                   { fileChanged (fp1); fileChanged (fp2); return "250 renamed to " + s + "\r\n"; }
                                                       return "553 unable to rename " + fileOrDirName + "\r\n";
       }
 
@@ -500,6 +490,7 @@ closeFtpConnection:
               free (buff);
             }
             f.close ();
+            fileChanged (fp);
           } else {
             ftpDmesg ("[ftpServer] could not open " + fp + " for writing.");
           }
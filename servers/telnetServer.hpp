@@ -361,7 +361,7 @@
         *line = "";
         
         char c;
-        while (tsp->connection->recvData (&c, 1)) { // read and process incomming data in a loop 
+        while (tsp->connection->readExactly (&c, 1)) { // read and process incomming data in a loop 
           switch (c) {
               case 3:   // Ctrl-C
                         *line = "";
@@ -393,15 +393,15 @@
                           // window size remains the same.
                           
                           if (c == 255) { // IAC
-                            if (!tsp->connection->recvData (&c, 1)) return 0;
+                            if (!tsp->connection->readExactly (&c, 1)) return 0;
                             switch (c) {
                               case 250: // SB
-                                        if (!tsp->connection->recvData (&c, 1)) return 0;
+                                        if (!tsp->connection->readExactly (&c, 1)) return 0;
                                         if (c == 31) { // NAWS
-                                          if (!tsp->connection->recvData ((char *) &tsp->clientWindowCol1, 1)) return 0;
-                                          if (!tsp->connection->recvData ((char *) &tsp->clientWindowCol2, 1)) return 0;
-                                          if (!tsp->connection->recvData ((char *) &tsp->clientWindowRow1, 1)) return 0;
-                                          if (!tsp->connection->recvData ((char *) &tsp->clientWindowRow2, 1)) return 0;
+                                          if (!tsp->connection->readExactly ((char *) &tsp->clientWindowCol1, 1)) return 0;
+                                          if (!tsp->connection->readExactly ((char *) &tsp->clientWindowCol2, 1)) return 0;
+                                          if (!tsp->connection->readExactly ((char *) &tsp->clientWindowRow1, 1)) return 0;
+                                          if (!tsp->connection->readExactly ((char *) &tsp->clientWindowRow2, 1)) return 0;
                                           // debug: Serial.printf ("[%10lu] [telnet] client reported its window size %i %i   %i %i\n", millis (), tsp->clientWindowCol1, tsp->clientWindowCol2, tsp->clientWindowRow1, tsp->clientWindowRow2);
                                         }
                                         break;
@@ -410,7 +410,7 @@
                               case 252:
                               case 253:
                               case 254:                        
-                                        if (!tsp->connection->recvData (&c, 1)) return 0;
+                                        if (!tsp->connection->readExactly (&c, 1)) return 0;
                               default: // ignore
                                         break;
                             }
@@ -754,7 +754,7 @@
           for (int i = 0; i < 880; i++) { // 880 instead of 1000 - a correction for more precise timing
             while (tsp->connection->available () == TcpConnection::AVAILABLE) {
               char c;
-              if (!tsp->connection->recvData (&c, sizeof (c))) return "";
+              if (!tsp->connection->readExactly (&c, sizeof (c))) return "";
               if (c == 3 || c >= ' ') return ""; // return if user pressed Ctrl-C or any key
             }
             delay (delaySeconds); // / 1000
@@ -788,7 +788,7 @@
           while (i == __dmesgEnd__) {
             while (tsp->connection->available () == TcpConnection::AVAILABLE) {
               char c;
-              if (!tsp->connection->recvData (&c, sizeof (c))) return "";
+              if (!tsp->connection->readExactly (&c, sizeof (c))) return "";
               if (c == 3 || c >= ' ') return ""; // return if user pressed Ctrl C or any key
             }
             delay (10); // wait a while and check again
@@ -915,23 +915,23 @@
           while (char c = __readLineFromClient__ (&line, true, tsp)) {
             switch (c) {
               case 0:   
-                      f.close ();
+                      f.close (); fileChanged (fp);
                       return fp + " not fully written.";
               case 4:
                       tsp->connection->sendData ((char *) "\r\n", 2);
                       s = (char *) line.c_str (); l = strlen (s);
                       if (l > 0) if (f.write ((uint8_t *) s, l) != l) {
-                        f.close ();
+                        f.close (); fileChanged (fp);
                         return "Can't write " + fp;
                       }
-                      f.close ();
+                      f.close (); fileChanged (fp);
                       return fp + " written.";
               case 13:
                       tsp->connection->sendData ((char *) "\r\n", 2);
                       line += "\r\n";
                       s = (char *) line.c_str (); l = strlen (s);
                       if (f.write ((uint8_t *) s, l) != l) { 
-                        f.close ();
+                        f.close (); fileChanged (fp);
                         return "Can't write " + fp;
                       } 
                       line = "";
@@ -1005,7 +1005,7 @@
         if (fp2 == "")                                  return "Invalid file or directory name " + dstFileOrDirectory;
         if (!userMayAccess (fp2, tsp->homeDir))         return "Access to " + fp2 + " denyed.";
 
-        if (FFat.rename (fp1, fp2))                     return "Renamed to " + fp2;
+        if (FFat.rename (fp1, fp2))                     { fileChanged (fp1); fileChanged (fp2); return "Renamed to " + fp2; }
                                                         return "Can't rename " + fp1;
       }
 
@@ -1034,6 +1034,7 @@
         }
     out3:
         f2.close ();
+        fileChanged (fp2);
     out2:
         f1.close ();
     out1:          
@@ -1550,7 +1551,7 @@
 
         // 3. discard any already pending characters from client
         char c;
-        while (tsp->connection->available () == TcpConnection::AVAILABLE) tsp->connection->recvData (&c, 1);
+        while (tsp->connection->available () == TcpConnection::AVAILABLE) tsp->connection->readExactly (&c, 1);
 
         // 4. get information about client window size
         byte clientWindowColumns = tsp->clientWindowCol2; 
@@ -1567,14 +1568,14 @@
           unsigned long m = millis (); while (tsp->connection->available () != TcpConnection::AVAILABLE && millis () - m < 500) delay (1);
           if (tsp->connection->available () == TcpConnection::AVAILABLE) {
             do {
-              if (!tsp->connection->recvData (&c, 1)) return "";
+              if (!tsp->connection->readExactly (&c, 1)) return "";
             } while (c != 255 /* IAC */); // ignore everything before IAC
-            tsp->connection->recvData (&c, 1); if (c != 250 /* SB */) return "Client send invalid reply to IAC DO NAWS."; // error in telnet protocol or connection closed
-            tsp->connection->recvData (&c, 1); if (c != 31 /* NAWS */) return "Client send invalid reply to IAC DO NAWS."; // error in telnet protocol or connection closed
-            tsp->connection->recvData (&c, 1); if (!tsp->connection->recvData ((char *) &clientWindowColumns, 1)) return ""; 
-            tsp->connection->recvData (&c, 1); if (!tsp->connection->recvData ((char *) &clientWindowRows, 1)) return "";
-            tsp->connection->recvData (&c, 1); // should be IAC, won't check if it is OK
-            tsp->connection->recvData (&c, 1); // should be SB, won't check if it is OK
+            tsp->connection->readExactly (&c, 1); if (c != 250 /* SB */) return "Client send invalid reply to IAC DO NAWS."; // error in telnet protocol or connection closed
+            tsp->connection->readExactly (&c, 1); if (c != 31 /* NAWS */) return "Client send invalid reply to IAC DO NAWS."; // error in telnet protocol or connection closed
+            tsp->connection->readExactly (&c, 1); if (!tsp->connection->readExactly ((char *) &clientWindowColumns, 1)) return ""; 
+            tsp->connection->readExactly (&c, 1); if (!tsp->connection->readExactly ((char *) &clientWindowRows, 1)) return "";
+            tsp->connection->readExactly (&c, 1); // should be IAC, won't check if it is OK
+            tsp->connection->readExactly (&c, 1); // should be SB, won't check if it is OK
             tsp->clientWindowCol2 = clientWindowColumns; tsp->clientWindowRow2 = clientWindowRows; 
             // debug: Serial.println ("Clinet reported its window size: " + String (clientWindowColumns) + " x " + String (clientWindowRows)); // return "";
           } else {
@@ -1667,7 +1668,7 @@
           // c. read and process incoming stream of characters
           char c = 0;
           delay (1);
-          if (!tsp->connection->recvData (&c, 1)) return "";
+          if (!tsp->connection->readExactly (&c, 1)) return "";
           // debug: Serial.printf ("[telnet vi debug] %c = %i\n", c, c);
           switch (c) {
             case 24:  // Ctrl-X
@@ -1675,7 +1676,7 @@
                         tsp->connection->sendData ("\x1b[" + String (clientWindowRows) + ";2H Save changes (y/n)? ");
                         redrawFooter = true; // overwrite this question at next redraw
                         while (true) {                                                     
-                          if (!tsp->connection->recvData (&c, 1)) return "";
+                          if (!tsp->connection->readExactly (&c, 1)) return "";
                           if (c == 'y') goto saveChanges;
                           if (c == 'n') break;
                         }
@@ -1697,15 +1698,16 @@ saveChanges:
                             }
                           }
                           f.close ();
+                          fileChanged (fp);
                         }
                         if (e) { message = " Could't save changes "; } else { message = " Changes saved "; dirty = 0; }
                       }
                       break;
 
             case 27:  // ESC [ 65 = up arrow, ESC [ 66 = down arrow, ESC[C = right arrow, ESC[D = left arrow, 
-                      if (!tsp->connection->recvData (&c, 1)) return "";
+                      if (!tsp->connection->readExactly (&c, 1)) return "";
                       if (c == '[') {
-                        if (!tsp->connection->recvData (&c, 1)) return "";
+                        if (!tsp->connection->readExactly (&c, 1)) return "";
                         // debug: Serial.printf ("%c = %i\n", c, c);
                         switch (c) {
                           case 'A':  // up arrow
@@ -1725,20 +1727,20 @@ saveChanges:
                                     else if (textCursorY > 0) { textCursorY--; textCursorX = line [textCursorY].length (); }
                                     break;        
                           case '1': // home
-                                    tsp->connection->recvData (&c, 1); // read final '~'
+                                    tsp->connection->readExactly (&c, 1); // read final '~'
                                     textCursorX = 0;
                                     break;
                           case '4': // end
-                                    tsp->connection->recvData (&c, 1); // read final '~'
+                                    tsp->connection->readExactly (&c, 1); // read final '~'
                                     textCursorX = line [textCursorY].length ();
                                     break;
                           case '5': // pgup
-                                    tsp->connection->recvData (&c, 1); // read final '~'
+                                    tsp->connection->readExactly (&c, 1); // read final '~'
                                     textCursorY -= (clientWindowRows - 2); if (textCursorY < 0) textCursorY = 0;
                                     if (textCursorX > line [textCursorY].length ()) textCursorX = line [textCursorY].length ();
                                     break;
                           case '6': // pgdn
-                                    tsp->connection->recvData (&c, 1); // read final '~'
+                                    tsp->connection->readExactly (&c, 1); // read final '~'
                                     textCursorY += (clientWindowRows - 2); if (textCursorY >= fileLines) textCursorY = fileLines - 1;
                                     if (textCursorX > line [textCursorY].length ()) textCursorX = line [textCursorY].length ();
                                     break;                                                                        
@@ -44,6 +44,16 @@
     #define HOSTNAME "MyESP32Server" // WiFi.getHostname() // use default if not defined
   #endif
 
+  #ifndef HTTP_SERVER_LATENCY_HISTOGRAM_SIZE
+    #define HTTP_SERVER_LATENCY_HISTOGRAM_SIZE 24 // latency histogram elements are powers of 2 microseconds, 24 of them go up to 16 s
+  #endif
+  #ifndef HTTP_SERVER_IDLE_TIMEOUT
+    #define HTTP_SERVER_IDLE_TIMEOUT 5000 // ms, persistent connection is closed if the next request doesn't arrive in this time (see setKeepAlive)
+  #endif
+  #ifndef HTTP_SERVER_MAX_REQUESTS_PER_CONNECTION
+    #define HTTP_SERVER_MAX_REQUESTS_PER_CONNECTION 100 // persistent connection is closed after this many requests, 0 for no limit (see setKeepAlive)
+  #endif
+
   // ----- includes, definitions and supporting functions -----
 
   #include <WiFi.h>
@@ -58,7 +68,7 @@
         }
         void (* webDmesg) (String) = __webDmesg__; // use this pointer to display / record system messages, if Telnet server is also included it will redirect it to its dmesg command
 
-  #include "common_functions.h"   // stristr, between
+  #include "common_functions.h"   // stristr
   #include "TcpServer.hpp"        // webServer.hpp is built upon TcpServer.hpp  
   #include "user_management.h"    // webServer.hpp needs user_management.h to get www home directory
   #include "file_system.h"        // webServer.hpp needs file_system.h to read files  from home directory
@@ -335,37 +345,24 @@ readingPayload:
                                                   __connection__->closeConnection ();
                                                   return false;                         
                                                 } 
-                                                byte *frame = NULL;
-                                                int frameSize;
+                                                byte header [4]; // frame header is sent together with the payload from a different buffer, so there is no need to copy them together
+                                                int headerSize;
+                                                header [0] = 0b10000000 | dataType; // set FIN bit and frame data type
                                                 if (bufferSize > 125) { // medium frame size
-                                                  if (!(frame = (byte *) malloc (frameSize = 4 + bufferSize))) { // 4 bytes for header (without mask) + payload
-                                                    Serial.printf ("[webSocket] malloc failed - out of memory\n");
-                                                    __connection__->closeConnection ();
-                                                    return false;
-                                                  }
-                                                  // frame type
-                                                  frame [0] = 0b10000000 | dataType; // set FIN bit and frame data type
-                                                  frame [1] = 126; // medium frame size, without masking (we won't do the masking, won't set the MASK bit)
-                                                  frame [2] = bufferSize >> 8; // / 256;
-                                                  frame [3] = bufferSize; // % 256;
-                                                  memcpy (frame + 4, buffer, bufferSize);  
+                                                  header [1] = 126; // medium frame size, without masking (we won't do the masking, won't set the MASK bit)
+                                                  header [2] = bufferSize >> 8; // / 256;
+                                                  header [3] = bufferSize; // % 256;
+                                                  headerSize = 4; // 4 bytes for header (without mask)
                                                 } else { // small frame size
-                                                  if (!(frame = (byte *) malloc (frameSize = 2 + bufferSize))) { // 2 bytes for header (without mask) + payload
-                                                    Serial.printf ("[webSocket] malloc failed - out of memory\n");
-                                                    __connection__->closeConnection ();
-                                                    return false;
-                                                  }
-                                                  frame [0] = 0b10000000 | dataType; // set FIN bit and frame data type
-                                                  frame [1] = bufferSize; // small frame size, without masking (we won't do the masking, won't set the MASK bit)
-                                                  if (bufferSize) memcpy (frame + 2, buffer, bufferSize);  
+                                                  header [1] = bufferSize; // small frame size, without masking (we won't do the masking, won't set the MASK bit)
+                                                  headerSize = 2; // 2 bytes for header (without mask)
                                                 }
-                                                if (__connection__->sendData ((char *) frame, frameSize) != frameSize) {
-                                                  free (frame);
+                                                struct iovec frame [2] = {{header, (size_t) headerSize}, {buffer, bufferSize}};
+                                                if (__connection__->sendData (frame, 2) != headerSize + (int) bufferSize) {
                                                   __connection__->closeConnection ();
                                                   Serial.printf ("[webSocket] failed to send frame\n");
                                                   return false;
                                                 }
-                                                free (frame);
                                                 return true;
                                               }
 
@@ -388,6 +385,359 @@ readingPayload:
   };
 
 
+/*
+ * httpRequestParser parses HTTP request incrementally, as its parts arrive, so nothing has to be scanned more than once.
+ * It doesn't copy anything, it just remembers where the request method, path, query, version and header fields are
+ * in the buffer that holds the request. Request body (if any) is framed according to Content-Length or chunked
+ * Transfer-Encoding so pipelined requests that follow it can be found.
+ */
+
+  #ifndef HTTP_SERVER_REQUEST_BUFFER_SIZE
+    #define HTTP_SERVER_REQUEST_BUFFER_SIZE 2048 // each connection reads HTTP requests into a buffer of this size, HTTP request header must fit into it
+  #endif
+  #ifndef HTTP_SERVER_MAX_HEADER_FIELDS
+    #define HTTP_SERVER_MAX_HEADER_FIELDS 24 // header fields beyond this number are ignored (but Content-Length and Transfer-Encoding are still taken into account)
+  #endif
+  #ifndef HTTP_SERVER_MAX_COOKIES
+    #define HTTP_SERVER_MAX_COOKIES 16 // cookies beyond this number are ignored
+  #endif
+  #ifndef HTTP_SERVER_MAX_ROUTE_NODES
+    #define HTTP_SERVER_MAX_ROUTE_NODES 64 // each distinct path segment of routes added with addRoute takes one node
+  #endif
+  #ifndef HTTP_SERVER_MAX_PATH_PARAMETERS
+    #define HTTP_SERVER_MAX_PATH_PARAMETERS 4 // the number of {parameters} in one route
+  #endif
+  #ifndef HTTP_SERVER_FILE_BLOCK_SIZE
+    #define HTTP_SERVER_FILE_BLOCK_SIZE 4096 // FFat cluster size, files are read from flash in blocks of this size (2 blocks per file being sent)
+  #endif
+  #ifndef HTTP_SERVER_MULTIPART_BUFFER_SIZE
+    #define HTTP_SERVER_MULTIPART_BUFFER_SIZE 4096 // readMultipartHttpRequestBody's sliding window, part data are passed to sink in pieces of up to this size, part header lines must fit into it
+  #endif
+  #ifndef HTTP_SERVER_RESPONSE_WRITER_BUFFER_SIZE
+    #define HTTP_SERVER_RESPONSE_WRITER_BUFFER_SIZE 1024 // httpResponseWriter's buffer (on the stack of connection thread), streamed replies are sent in chunks of at least this size
+  #endif
+  #ifndef HTTP_SERVER_MAX_CACHE_CONTROL_DIRECTORIES
+    #define HTTP_SERVER_MAX_CACHE_CONTROL_DIRECTORIES 4 // the number of directories that may have their own Cache-Control (see setCacheControl)
+  #endif
+  #ifndef HTTP_SERVER_FILE_CACHE_SIZE
+    #define HTTP_SERVER_FILE_CACHE_SIZE (64 * 1024) // heap that may be used for keeping recently served files in RAM, 0 disables file cache
+  #endif
+  #ifndef HTTP_SERVER_FILE_CACHE_MAX_FILE_SIZE
+    #define HTTP_SERVER_FILE_CACHE_MAX_FILE_SIZE (HTTP_SERVER_FILE_CACHE_SIZE * 3 / 4) // larger files are always read from file system
+  #endif
+  #ifndef HTTP_SERVER_RESPONSE_CACHE_ENTRIES
+    #define HTTP_SERVER_RESPONSE_CACHE_ENTRIES 8 // the number of route replies (different paths) that may be kept for their time-to-live (see addRoute), 0 disables response cache
+  #endif
+  #if HTTP_SERVER_RESPONSE_CACHE_ENTRIES > 24
+    #error "HTTP_SERVER_RESPONSE_CACHE_ENTRIES can't be more than 24 (each entry needs its own bit in a FreeRTOS event group)"
+  #endif
+  #ifndef HTTP_SERVER_RESPONSE_CACHE_WAIT
+    #define HTTP_SERVER_RESPONSE_CACHE_WAIT 1000 // ms, how long a request waits for another thread's reply to the same path before calling route handler itself (without caching its reply)
+  #endif
+  #ifndef HTTP_SERVER_ACCESS_LOG_RING_SIZE
+    #define HTTP_SERVER_ACCESS_LOG_RING_SIZE 64 // access log records waiting in RAM to be written to file, records that don't fit are dropped (see startAccessLog)
+  #endif
+  #ifndef HTTP_SERVER_ACCESS_LOG_FLUSH_INTERVAL
+    #define HTTP_SERVER_ACCESS_LOG_FLUSH_INTERVAL 5000 // ms, access log records are written to file at least this often (or sooner, when half of the ring is full)
+  #endif
+  #ifndef HTTP_SERVER_ACCESS_LOG_MAX_FILE_SIZE
+    #define HTTP_SERVER_ACCESS_LOG_MAX_FILE_SIZE (64 * 1024) // access log file larger than this is renamed to file.1 and a new one is started
+  #endif
+  #ifndef HTTP_SERVER_MAX_EVENT_STREAMS
+    #define HTTP_SERVER_MAX_EVENT_STREAMS 4 // the number of Server-Sent Events paths (see addEventStream)
+  #endif
+  #ifndef HTTP_SERVER_EVENT_QUEUE_LENGTH
+    #define HTTP_SERVER_EVENT_QUEUE_LENGTH 16 // the number of the latest events kept for slow or reconnecting (Last-Event-ID) subscribers
+  #endif
+  #ifndef HTTP_SERVER_SESSION_CAPACITY
+    #define HTTP_SERVER_SESSION_CAPACITY 32 // the number of web sessions (logged in browsers) that may exist at the same time, the least recently active one is evicted to make room for a new one
+  #endif
+  #ifndef HTTP_SERVER_MAX_SESSIONS_PER_USER
+    #define HTTP_SERVER_MAX_SESSIONS_PER_USER 4 // user's least recently active session is evicted when the user opens more sessions than this (logs in from more browsers)
+  #endif
+  #ifndef HTTP_SERVER_SESSION_TIMEOUT
+    #define HTTP_SERVER_SESSION_TIMEOUT (15 * 60) // s, web session expires if it is not used for this long, each request that uses it prolongs it
+  #endif
+  #define __HTTP_SESSION_HASH_SIZE__ 64 // must be a power of 2 and at least twice HTTP_SERVER_SESSION_CAPACITY so that open addressing works fine
+  #if HTTP_SERVER_SESSION_CAPACITY * 2 > __HTTP_SESSION_HASH_SIZE__
+    #error "HTTP_SERVER_SESSION_CAPACITY is too large for __HTTP_SESSION_HASH_SIZE__"
+  #endif
+  #define __HTTP_HEADER_HASH_SIZE__ 64 // must be a power of 2 and larger than HTTP_SERVER_MAX_HEADER_FIELDS (and HTTP_SERVER_MAX_COOKIES) so that open addressing works fine
+  #define __HTTP_METHOD_COUNT__ 7
+  #define __HTTP_ROUTE_HASH_SIZE__ 128 // must be a power of 2 and at least twice HTTP_SERVER_MAX_ROUTE_NODES
+  #define __HTTP_FILE_WRITE_COUNTERS__ 32 // must be a power of 2, files whose names hash to the same counter share it (they just get new ETags more often than needed)
+
+  struct httpField {                                // points to a part of HTTP request (method, path, header field value, ...) so nothing gets copied
+    const char *value;                              // not terminated with 0!
+    int length;
+
+    bool equals (const char *s) const               { return (int) strlen (s) == length && !strncmp (value, s, length); }
+    bool equalsIgnoreCase (const char *s) const     { return (int) strlen (s) == length && !strncasecmp (value, s, length); }
+    bool containsIgnoreCase (const char *s) const   { // useful for checking comma separated tokens, like Connection: keep-alive, Upgrade
+                                                      int l = strlen (s);
+                                                      for (int i = 0; i + l <= length; i++) if (!strncasecmp (value + i, s, l)) return true;
+                                                      return false;
+                                                    }
+    String toString () const                        { String s; if (length) s.concat (value, length); return s; }
+  };
+
+  class httpRequestParser {
+
+    public:
+
+      enum PARSER_RESULT_TYPE {
+        INCOMPLETE = 0,                             // the end of HTTP request header hasn't arrived yet
+        COMPLETE = 1,                               // HTTP request header is complete
+        BAD_REQUEST = 2                             // HTTP request is not formed correctly
+      };
+
+      struct field {                                // position of a part of HTTP request relative to the beginning of the request
+        uint16_t offset;
+        uint16_t length;
+      };
+
+      field method;
+      field path;                                   // without query
+      field query;                                  // without '?'
+      field version;
+      struct {
+        field name;
+        field value;
+      } headerField [HTTP_SERVER_MAX_HEADER_FIELDS];
+      int headerFieldCount;
+      struct {
+        field name;
+        field value;
+      } cookie [HTTP_SERVER_MAX_COOKIES];
+      int cookieCount;                              // -1 until Cookie header field is parsed (the first time a cookie is needed)
+      int headerLength;                             // length of HTTP request header including final \r\n\r\n (when COMPLETE)
+      long contentLength;                           // -1 if Content-Length is not given
+      bool chunked;                                 // Transfer-Encoding: chunked
+
+      httpRequestParser ()                          { reset (); }
+
+      void reset ()                                 { // prepare for the next request
+                                                      method = path = query = version = {0, 0};
+                                                      headerFieldCount = headerLength = 0;
+                                                      cookieCount = -1;
+                                                      memset (__headerHash__, 0, sizeof (__headerHash__));
+                                                      contentLength = -1;
+                                                      chunked = false;
+                                                      __lineStart__ = 0;
+                                                      __state__ = REQUEST_LINE;
+                                                      __bodyState__ = BODY_NOT_STARTED;
+                                                    }
+
+      PARSER_RESULT_TYPE parse (const char *buffer, int length) { // buffer starts with HTTP request and holds length bytes that have arrived so far, each call continues where the previous one stopped
+        while (__state__ == REQUEST_LINE || __state__ == HEADER_FIELDS) {
+          const char *eol = (const char *) memchr (buffer + __lineStart__, '\n', length - __lineStart__);
+          if (!eol) return INCOMPLETE;
+          int lineEnd = eol - buffer; // position of \n
+          int lineLength = lineEnd - __lineStart__;
+          if (lineLength && buffer [lineEnd - 1] == '\r') lineLength --;
+          const char *line = buffer + __lineStart__;
+
+          if (__state__ == REQUEST_LINE) { // method SP request-target SP HTTP-version
+            if (!lineLength && !__lineStart__) { __lineStart__ = lineEnd + 1; continue; } // tolerate empty line(s) before request line - this only works while it is at the beginning of buffer
+            const char *sp1 = (const char *) memchr (line, ' ', lineLength);
+            const char *sp2 = sp1 ? (const char *) memchr (sp1 + 1, ' ', line + lineLength - sp1 - 1) : NULL;
+            if (!sp2 || sp1 == line || sp2 == sp1 + 1 || line + lineLength - sp2 - 1 < 8 || strncmp (sp2 + 1, "HTTP/", 5)) return __badRequest__ ();
+            method = {(uint16_t) (line - buffer), (uint16_t) (sp1 - line)};
+            const char *q = (const char *) memchr (sp1 + 1, '?', sp2 - sp1 - 1);
+            path = {(uint16_t) (sp1 + 1 - buffer), (uint16_t) ((q ? q : sp2) - sp1 - 1)};
+            if (q) query = {(uint16_t) (q + 1 - buffer), (uint16_t) (sp2 - q - 1)};
+            else   query = {(uint16_t) (sp2 - buffer), 0};
+            version = {(uint16_t) (sp2 + 1 - buffer), (uint16_t) (line + lineLength - sp2 - 1)};
+            __state__ = HEADER_FIELDS;
+
+          } else if (!lineLength) { // empty line concludes HTTP request header
+            if (chunked && contentLength >= 0) return __badRequest__ (); // a proxy in front of the server might frame the body by Content-Length while we would frame it by chunks (request smuggling)
+            headerLength = lineEnd + 1;
+            __state__ = HEADER_COMPLETE;
+            return COMPLETE;
+
+          } else { // field-name ":" OWS field-value OWS
+            const char *colon = (const char *) memchr (line, ':', lineLength);
+            if (!colon || colon == line || *line == ' ' || *line == '\t') return __badRequest__ (); // obsolete line folding is not supported
+            const char *v = colon + 1;
+            const char *e = line + lineLength;
+            while (v < e && (*v == ' ' || *v == '\t')) v ++;
+            while (e > v && (*(e - 1) == ' ' || *(e - 1) == '\t')) e --;
+            httpField name = {line, (int) (colon - line)};
+            httpField value = {v, (int) (e - v)};
+            if (name.equalsIgnoreCase ("Content-Length")) {
+              if (!value.length || contentLength >= 0) return __badRequest__ (); // Content-Length must be a number and it may only appear once
+              contentLength = 0;
+              for (int i = 0; i < value.length; i++) {
+                if (value.value [i] < '0' || value.value [i] > '9' || contentLength > 0xFFFFFFF) return __badRequest__ ();
+                contentLength = contentLength * 10 + value.value [i] - '0';
+              }
+            } else if (name.equalsIgnoreCase ("Transfer-Encoding")) { // chunked is the only transfer coding httpServer can decode, anything else (gzip, chunked, chunked twice, ...) can't be framed reliably
+              if (chunked || !value.equalsIgnoreCase ("chunked")) return __badRequest__ ();
+              chunked = true;
+            }
+            if (headerFieldCount < HTTP_SERVER_MAX_HEADER_FIELDS) {
+              headerField [headerFieldCount].name = {(uint16_t) (line - buffer), (uint16_t) name.length};
+              headerField [headerFieldCount].value = {(uint16_t) (v - buffer), (uint16_t) value.length};
+              if (headerFieldIndex (buffer, name.value, name.length) < 0) __insertIntoHash__ (__headerHash__, __hash__ (name.value, name.length), headerFieldCount); // if the same field name repeats only the first one is indexed
+              headerFieldCount ++;
+            }
+          }
+          __lineStart__ = lineEnd + 1;
+        }
+        return __state__ == HEADER_COMPLETE ? COMPLETE : BAD_REQUEST;
+      }
+
+      // ----- body framing -----
+
+      bool bodyComplete ()                          { return __bodyState__ == BODY_COMPLETE || (__bodyState__ == BODY_NOT_STARTED && !chunked && contentLength <= 0); }
+
+      void skipBody ()                              { __bodyState__ = BODY_COMPLETE; } // use this if the whole body has already been consumed some other way
+
+      int decodeBody (char *data, int dataLength, char **bodyPart, int *bodyPartLength) { // decodes the body from data that follow HTTP request header,
+                                                                                          // returns the number of data bytes consumed (0 if more data is needed) and the decoded part of the body (which may be empty)
+        *bodyPart = data;
+        *bodyPartLength = 0;
+        if (__bodyState__ == BODY_NOT_STARTED) {
+          if (bodyComplete ()) { __bodyState__ = BODY_COMPLETE; return 0; }
+          if (chunked) {
+            __bodyState__ = CHUNK_SIZE;
+          } else {
+            __bodyState__ = IDENTITY_BODY;
+            __bodyRemaining__ = contentLength;
+          }
+        }
+        switch (__bodyState__) {
+          case IDENTITY_BODY:
+          case CHUNK_DATA:        {
+                                    int l = (unsigned long) dataLength < __bodyRemaining__ ? dataLength : __bodyRemaining__;
+                                    *bodyPartLength = l;
+                                    if (!(__bodyRemaining__ -= l)) __bodyState__ = __bodyState__ == IDENTITY_BODY ? BODY_COMPLETE : CHUNK_DATA_END;
+                                    return l;
+                                  }
+          case CHUNK_SIZE:        // chunk-size [; chunk-ext] CRLF
+          case CHUNK_DATA_END:    // CRLF
+          case TRAILER:           { // *(field-line CRLF) CRLF
+                                    const char *eol = (const char *) memchr (data, '\n', dataLength);
+                                    if (!eol) return 0;
+                                    int l = eol - data + 1;
+                                    if (__bodyState__ == CHUNK_SIZE) {
+                                      __bodyRemaining__ = 0;
+                                      int i;
+                                      for (i = 0; i < l && isxdigit ((unsigned char) data [i]); i++) {
+                                        if (__bodyRemaining__ > 0xFFFFFFF) { __bodyState__ = BODY_ERROR; return 0; }
+                                        __bodyRemaining__ = __bodyRemaining__ * 16 + (isdigit ((unsigned char) data [i]) ? data [i] - '0' : (data [i] | 0x20) - 'a' + 10);
+                                      }
+                                      if (!i) { __bodyState__ = BODY_ERROR; return 0; }
+                                      __bodyState__ = __bodyRemaining__ ? CHUNK_DATA : TRAILER; // the last chunk has size 0
+                                    } else if (__bodyState__ == CHUNK_DATA_END) {
+                                      __bodyState__ = CHUNK_SIZE;
+                                    } else { // trailer
+                                      if (l <= 2) __bodyState__ = BODY_COMPLETE; // empty line concludes the trailer
+                                    }
+                                    return l;
+                                  }
+          default:                return 0;
+        }
+      }
+
+      bool bodyError ()                             { return __bodyState__ == BODY_ERROR; }
+
+      unsigned long bodyDataRemaining ()            { // the number of body bytes that follow without any framing (the rest of identity body or current chunk), 0 if decodeBody expects a line next
+                                                      if (__bodyState__ == BODY_NOT_STARTED && !chunked && contentLength > 0) return contentLength;
+                                                      return __bodyState__ == IDENTITY_BODY || __bodyState__ == CHUNK_DATA ? __bodyRemaining__ : 0;
+                                                    }
+
+      // ----- header fields and cookies are indexed in hash tables so finding them doesn't require scanning -----
+
+      int headerFieldIndex (const char *buffer, const char *name, int nameLength = -1) { // returns the index of header field with the given name (case insensitive) or -1 if it is not there
+        if (nameLength < 0) nameLength = strlen (name);
+        for (int slot = __hash__ (name, nameLength) & (__HTTP_HEADER_HASH_SIZE__ - 1); __headerHash__ [slot]; slot = (slot + 1) & (__HTTP_HEADER_HASH_SIZE__ - 1)) {
+          int i = __headerHash__ [slot] - 1;
+          if (headerField [i].name.length == nameLength && !strncasecmp (buffer + headerField [i].name.offset, name, nameLength)) return i;
+        }
+        return -1;
+      }
+
+      int cookieIndex (const char *buffer, const char *name, int nameLength = -1) { // returns the index of cookie with the given name (case sensitive) or -1 if it is not there
+        if (cookieCount < 0) __parseCookies__ (buffer);
+        if (nameLength < 0) nameLength = strlen (name);
+        for (int slot = __hash__ (name, nameLength) & (__HTTP_HEADER_HASH_SIZE__ - 1); __cookieHash__ [slot]; slot = (slot + 1) & (__HTTP_HEADER_HASH_SIZE__ - 1)) {
+          int i = __cookieHash__ [slot] - 1;
+          if (cookie [i].name.length == nameLength && !strncmp (buffer + cookie [i].name.offset, name, nameLength)) return i;
+        }
+        return -1;
+      }
+
+    private:
+
+      enum PARSER_STATE_TYPE {
+        REQUEST_LINE = 0,
+        HEADER_FIELDS = 1,
+        HEADER_COMPLETE = 2,
+        PARSER_ERROR = 3
+      };
+      PARSER_STATE_TYPE __state__;
+      int __lineStart__;                            // where the next (not yet parsed) line of HTTP request header begins
+
+      enum BODY_STATE_TYPE {
+        BODY_NOT_STARTED = 0,
+        IDENTITY_BODY = 1,                          // Content-Length bytes
+        CHUNK_SIZE = 2,
+        CHUNK_DATA = 3,
+        CHUNK_DATA_END = 4,
+        TRAILER = 5,
+        BODY_COMPLETE = 6,
+        BODY_ERROR = 7
+      };
+      BODY_STATE_TYPE __bodyState__;
+      unsigned long __bodyRemaining__;              // bytes remaining in identity body or in current chunk
+
+      PARSER_RESULT_TYPE __badRequest__ ()          { __state__ = PARSER_ERROR; return BAD_REQUEST; }
+
+      uint8_t __headerHash__ [__HTTP_HEADER_HASH_SIZE__]; // header field index + 1 or 0 for empty slot
+      uint8_t __cookieHash__ [__HTTP_HEADER_HASH_SIZE__]; // cookie index + 1 or 0 for empty slot
+
+      static unsigned int __hash__ (const char *s, int length) { // case insensitive FNV-1a (cookie names are case sensitive but this is checked when comparing them)
+        unsigned int h = 2166136261;
+        for (int i = 0; i < length; i++) h = (h ^ (uint8_t) tolower ((unsigned char) s [i])) * 16777619;
+        return h;
+      }
+
+      static void __insertIntoHash__ (uint8_t *hashTable, unsigned int hash, int index) { // open addressing with linear probing
+        int slot = hash & (__HTTP_HEADER_HASH_SIZE__ - 1);
+        while (hashTable [slot]) slot = (slot + 1) & (__HTTP_HEADER_HASH_SIZE__ - 1);
+        hashTable [slot] = index + 1;
+      }
+
+      void __parseCookies__ (const char *buffer) { // Cookie: name1=value1; name2=value2 ...
+        cookieCount = 0;
+        memset (__cookieHash__, 0, sizeof (__cookieHash__));
+        int i = headerFieldIndex (buffer, "Cookie", 6);
+        if (i < 0) return;
+        const char *p = buffer + headerField [i].value.offset;
+        const char *e = p + headerField [i].value.length;
+        while (p < e && cookieCount < HTTP_SERVER_MAX_COOKIES) {
+          while (p < e && (*p == ' ' || *p == ';')) p ++;
+          const char *n = p;
+          while (p < e && *p != '=' && *p != ';') p ++;
+          if (p == e || *p != '=') continue; // not name=value, skip it
+          const char *ne = p;
+          while (ne > n && *(ne - 1) == ' ') ne --;
+          const char *v = ++ p;
+          while (p < e && *p != ';') p ++;
+          const char *ve = p;
+          while (ve > v && *(ve - 1) == ' ') ve --;
+          if (v < ve && *v == '"' && *(ve - 1) == '"' && ve - v >= 2) { v ++; ve --; } // cookie value may be quoted
+          cookie [cookieCount].name = {(uint16_t) (n - buffer), (uint16_t) (ne - n)};
+          cookie [cookieCount].value = {(uint16_t) (v - buffer), (uint16_t) (ve - v)};
+          if (cookieIndex (buffer, n, ne - n) < 0) __insertIntoHash__ (__cookieHash__, __hash__ (n, ne - n), cookieCount); // if the same cookie name repeats only the first one is indexed
+          cookieCount ++;
+        }
+      }
+  };
+
+
 /*
  * httpServer is inherited from TcpServer with connection handler that handles connections according
  * to HTTP protocol.
@@ -401,40 +751,88 @@ readingPayload:
   
   class httpServer: public TcpServer {                                             
   
+    private:
+
+      struct __httpConnectionState__; // wwwSessionParameters need it to read request body
+
     public:
 
+      // multipart/form-data request body (HTML form with file upload) is read part by part, each part's data are passed to sink callback in pieces as they arrive
+      struct httpMultipartPart {
+        String name;                                // form field name
+        String fileName;                            // the name of uploaded file, "" if the part is not a file
+        String contentType;                         // "" if the part doesn't have Content-Type
+        unsigned long length;                       // data bytes passed to sink so far
+      };
+      enum MULTIPART_EVENT_TYPE {
+        MULTIPART_PART_BEGIN,                       // part header has been read
+        MULTIPART_PART_DATA,                        // the next piece of part data
+        MULTIPART_PART_END,                         // all part data have been passed to sink
+        MULTIPART_PART_FAILED                       // the body ended (or sink returned false) in the middle of the part
+      };
+      typedef bool (*httpMultipartSink) (MULTIPART_EVENT_TYPE event, httpMultipartPart *part, const char *data, int dataLength, void *param); // returns false to stop reading
+
       // keep www session parameters in a structure - try to keep compatibility with previous version
             
       class wwwSessionParameters {
         public:
-          wwwSessionParameters (String *httpRequest, String *homeDirectory, TcpConnection *cnn)  {
+          wwwSessionParameters (String *httpRequest, String *homeDirectory, TcpConnection *cnn, httpServer *srv = NULL, httpRequestParser *parser = NULL)  {
                                                                                                     __httpRequest__ = httpRequest;
                                                                                                     homeDir = *homeDirectory;
                                                                                                     connection = cnn;
+                                                                                                    server = srv;
+                                                                                                    __parser__ = parser;
                                                                                                   }
           // parameters
           String homeDir; // web server home directory
           TcpConnection *connection;
+          httpServer *server; // web server that is handling the request
           // feel free to add more
+          // reading already parsed HTTP request - returned httpFields point into httpRequest (so calling program shouldn't change httpRequest while it uses them)
+          httpField getHttpRequestMethod ()             { return __field__ (__parser__ ? __parser__->method : httpRequestParser::field {0, 0}); }
+          httpField getHttpRequestPath ()               { return __field__ (__parser__ ? __parser__->path : httpRequestParser::field {0, 0}); }  // without query
+          httpField getHttpRequestQuery ()              { return __field__ (__parser__ ? __parser__->query : httpRequestParser::field {0, 0}); } // whatever follows '?'
+          httpField getHttpRequestVersion ()            { return __field__ (__parser__ ? __parser__->version : httpRequestParser::field {0, 0}); }
+          int getHttpRequestHeaderFieldCount ()         { return __parser__ ? __parser__->headerFieldCount : 0; }
+          httpField getHttpRequestHeaderFieldName (int i)  { return __field__ (__parser__->headerField [i].name); }
+          httpField getHttpRequestHeaderFieldValue (int i) { return __field__ (__parser__->headerField [i].value); }
+          long getHttpRequestContentLength ()           { return __parser__ ? __parser__->contentLength : -1; } // -1 if Content-Length is not given
+          httpField getHttpRequestBody ()               { // request body if it was small enough to be received together with the header (Content-Length bytes) or empty
+                                                          if (!__parser__ || __httpRequest__->length () <= (unsigned int) __parser__->headerLength) return {"", 0};
+                                                          return {__httpRequest__->c_str () + __parser__->headerLength, (int) (__httpRequest__->length () - __parser__->headerLength)};
+                                                        }
+          int readHttpRequestBody (char *buffer, int bufferSize) { // reads the next part of request body (decoded if it is chunked) into buffer, returns the number of bytes read, 0 when the whole body has been read or -1 on error,
+                                                          // blocks until some data arrives, so the body of any size can be processed in parts as it arrives - without keeping it in memory
+                                                          // (the part of the body that has been received together with the header and is therefore already in getHttpRequestBody () is returned first)
+                                                          if (!server || !__connectionState__) return -1;
+                                                          return server->__readHttpRequestBody__ (*__connectionState__, this, buffer, bufferSize);
+                                                        }
+          bool readMultipartHttpRequestBody (httpMultipartSink sink, void *param = NULL) { // reads multipart/form-data body and passes its parts to sink, returns true if the whole body has been read and sink accepted everything
+                                                          if (!server) return false;
+                                                          return server->__readMultipartHttpRequestBody__ (this, sink, param);
+                                                        }
+          httpField getHttpRequestPathParameter (const char *name) { // returns the value of {name} path parameter of the route that matched HTTP request (see addRoute) or empty httpField
+                                                          for (int i = 0; i < __pathParameterCount__; i++) if (!strcmp (__pathParameter__ [i].name, name)) return __field__ (__pathParameter__ [i].value);
+                                                          return {"", 0};
+                                                        }
           // reading HTTP request
-          String getHttpRequestHeaderField (String fieldName) { // HTTP header fields are in format \r\nfieldName: fieldValue\r\n
-                                                                char *httpRequest = (char *) (*__httpRequest__).c_str ();
-                                                                char *p = stristr (httpRequest, (char *) ("\n" + fieldName + ":").c_str ()); // find field name in HTTP header
-                                                                if (p) {
-                                                                  p += 1 + fieldName.length () + 1; // pass \n fieldname and :
-                                                                  char *q = strstr (p, "\r"); // find end of line - should always succeed
-                                                                  if (q) {
-                                                                    String fieldValue = __httpRequest__->substring (p - httpRequest, q - httpRequest);
-                                                                    fieldValue.trim ();
-                                                                    return fieldValue;
-                                                                  }
-                                                                }
-                                                                return "";
+          httpField findHttpRequestHeaderField (const char *fieldName) { // returns the value of header field (case insensitive) or empty httpField if it is not there
+                                                                if (!__parser__) return {"", 0};
+                                                                int i = __parser__->headerFieldIndex (__httpRequest__->c_str (), fieldName);
+                                                                return i < 0 ? httpField {"", 0} : __field__ (__parser__->headerField [i].value);
                                                               }
-          String getHttpRequestCookie (String cookieName) { // cookies are passed from browser to http server in "cookie" HTTP header field
-                                                            String cookies = " " + getHttpRequestHeaderField ("Cookie") + ";";
-                                                            return between (cookies, " " + cookieName + "=", ";");
-                                                          }
+          httpField findHttpRequestCookie (const char *cookieName) { // returns the value of cookie or empty httpField if it is not there
+                                                                if (!__parser__) return {"", 0};
+                                                                int i = __parser__->cookieIndex (__httpRequest__->c_str (), cookieName);
+                                                                return i < 0 ? httpField {"", 0} : __field__ (__parser__->cookie [i].value);
+                                                              }
+          String getHttpRequestHeaderField (String fieldName) { return findHttpRequestHeaderField (fieldName.c_str ()).toString (); } // HTTP header fields are in format \r\nfieldName: fieldValue\r\n
+          String getHttpRequestCookie (String cookieName) { return findHttpRequestCookie (cookieName.c_str ()).toString (); } // cookies are passed from browser to http server in "cookie" HTTP header field
+          String getSessionUserName ()                  { // returns the user name of web session whose token the browser sent in sessionToken cookie (and prolongs the session) or "" if it is not logged in
+                                                          if (!server) return "";
+                                                          httpField token = findHttpRequestCookie ("sessionToken");
+                                                          return server->__sessionUserName__ (token.value, token.length);
+                                                        }
           // setting HTTP response
           String httpResponseStatus = "200 OK"; // by default
           void setHttpResponseHeaderField (String fieldName, String fieldValue) { httpResponseHeaderFields += fieldName + ":" + fieldValue + "\r\n"; }
@@ -450,18 +848,111 @@ readingPayload:
           friend class httpServer;
           // remember HTTP request
           String *__httpRequest__;
+          httpRequestParser *__parser__;
+          struct {
+            const char *name;
+            httpRequestParser::field value;
+          } __pathParameter__ [HTTP_SERVER_MAX_PATH_PARAMETERS];
+          int __pathParameterCount__ = 0;
+          // reading request body
+          __httpConnectionState__ *__connectionState__ = NULL;
+          int __bodyBytesRead__ = 0;                    // from the part of the body that is already in HTTP request
+          bool __continueSent__ = false;                // 100 Continue reply to Expect: 100-continue
+          httpField __field__ (httpRequestParser::field f) { return {__httpRequest__->c_str () + f.offset, f.length}; }
           // construct HTTP reply
           String httpResponseHeaderFields = "";
       };
 
+      // Streamed reply: instead of building the whole reply in a String, streaming route handler (see addRoute) writes it in pieces 
+      // through httpResponseWriter. The pieces are collected in a fixed buffer and sent with chunked transfer encoding whenever the 
+      // buffer gets full, so the size of the reply is not limited by free heap. A reply that fits into the buffer is sent with 
+      // Content-Length as usual.
+      class httpResponseWriter {
+        public:
+          httpResponseWriter (wwwSessionParameters *wsp) {
+                                                            __wsp__ = wsp;
+                                                            __chunked__ = wsp->getHttpRequestVersion ().equals ("HTTP/1.1"); // HTTP/1.0 clients don't understand chunked transfer encoding, the end of reply will be marked by closing the connection instead
+                                                          }
+
+          bool setStatus (String status) {                // like "404 Not found", the default is "200 OK", returns false if it is too late since the beginning of reply has already been sent
+                                                            if (__headerSent__) return false;
+                                                            __wsp__->httpResponseStatus = status;
+                                                            return true;
+                                                          }
+
+          bool setHeader (String fieldName, String fieldValue) { // returns false if it is too late since the beginning of reply has already been sent
+                                                            if (__headerSent__) return false;
+                                                            __wsp__->setHttpResponseHeaderField (fieldName, fieldValue);
+                                                            return true;
+                                                          }
+
+          bool write (const char *buffer, size_t length) { // returns false if the connection has been lost
+                                                            if (__failed__) return false;
+                                                            if (__length__ + length <= sizeof (__buffer__)) { memcpy (__buffer__ + __length__, buffer, length); __length__ += length; return true; }
+                                                            return __sendChunk__ (buffer, length); // send what is already in the buffer together with the new data (without copying it into the buffer first)
+                                                          }
+
+          bool write (String s) { return write (s.c_str (), s.length ()); }
+
+        private:
+          friend class httpServer;
+          wwwSessionParameters *__wsp__;
+          bool __chunked__;
+          bool __headerSent__ = false;
+          bool __failed__ = false;
+          size_t __length__ = 0;
+          char __buffer__ [HTTP_SERVER_RESPONSE_WRITER_BUFFER_SIZE];
+
+          bool __sendChunk__ (const char *data, size_t dataLength) { // sends buffer + data as one chunk
+            String httpHeader;
+            char chunkSize [12];
+            struct iovec segment [5];
+            int segmentCount = 0;
+            if (!__headerSent__) {
+              if (!__chunked__ && __wsp__->httpResponseHeaderFields.startsWith ("Connection:keep-alive\r\n")) __wsp__->httpResponseHeaderFields.remove (0, 23); // the end of reply will be marked by closing the connection
+              httpHeader = "HTTP/1.1 " + __wsp__->httpResponseStatus + "\r\n" + __wsp__->httpResponseHeaderFields + (__chunked__ ? "Transfer-Encoding:chunked\r\n\r\n" : "Connection:close\r\n\r\n");
+              segment [segmentCount ++] = {(char *) httpHeader.c_str (), httpHeader.length ()};
+              __headerSent__ = true;
+            }
+            if (__chunked__) { sprintf (chunkSize, "%x\r\n", (unsigned int) (__length__ + dataLength)); segment [segmentCount ++] = {chunkSize, strlen (chunkSize)}; }
+            segment [segmentCount ++] = {__buffer__, __length__};
+            segment [segmentCount ++] = {(char *) data, dataLength};
+            if (__chunked__) segment [segmentCount ++] = {(char *) "\r\n", 2};
+            size_t toSend = 0; for (int i = 0; i < segmentCount; i++) toSend += segment [i].iov_len;
+            __length__ = 0;
+            if (__wsp__->connection->sendData (segment, segmentCount) < (int) toSend) __failed__ = true;
+            return !__failed__;
+          }
+
+          bool __finish__ () { // sends whatever is left, returns true if the connection may be kept alive
+            if (__failed__) return false;
+            if (!__headerSent__) { // the whole reply fits into the buffer, no need for chunked transfer encoding
+              String httpHeader = "HTTP/1.1 " + __wsp__->httpResponseStatus + "\r\n" + __wsp__->httpResponseHeaderFields + "Content-Length:" + String ((unsigned long) __length__) + "\r\n\r\n";
+              struct iovec httpResponse [2] = {{(char *) httpHeader.c_str (), httpHeader.length ()}, {__buffer__, __length__}};
+              __headerSent__ = true;
+              return __wsp__->connection->sendData (httpResponse, 2) == (int) (httpHeader.length () + __length__);
+            }
+            if (__length__ && !__sendChunk__ (NULL, 0)) return false;
+            if (!__chunked__) return false; // the end of reply is marked by closing the connection
+            return __wsp__->connection->sendData ((char *) "0\r\n\r\n", 5) == 5; // the last chunk
+          }
+      };
+
       httpServer (String (*httpRequestHandler) (String& httpRequest, httpServer::wwwSessionParameters *wsp),  // httpRequestHandler callback function provided by calling program
                   void (*wsRequestHandler) (String& wsRequest, WebSocket *webSocket),                         // httpRequestHandler callback function provided by calling program      
                   unsigned int stackSize,                                                                     // stack size of httpRequestHandler thread, usually 4 KB will do 
                   char *serverIP,                                                                             // web server IP address, 0.0.0.0 for all available IP addresses - 15 characters at most!
                   int serverPort,                                                                             // web server port
-                  bool (*firewallCallback) (char *)                                                           // a reference to callback function that will be celled when new connection arrives 
-                 ): TcpServer (__webConnectionHandler__, this, stackSize, 1500, serverIP, serverPort, firewallCallback)
+                  bool (*firewallCallback) (char *),                                                          // a reference to callback function that will be celled when new connection arrives 
+                  bool runAsReactor = false,                                                                  // if true all connections are handled by one thread (with stackSize stack), only WebSockets and event streams get threads of their own - see __webConnectionEventHandler__ before using it
+                  unsigned int workerPoolSize = 0,                                                            // if > 0 connections are handled by this many pre-started threads (each with stackSize stack) instead of a new thread for each connection
+                  unsigned int acceptQueueLength = 8,                                                         // how many connections may wait for a free worker thread
+                  OVERFLOW_POLICY_TYPE overflowPolicy = TcpServer::REJECT_WHEN_BUSY                           // what to do with new connection when all worker threads are busy and accept queue is full
+                 ): TcpServer (__webConnectionHandler__, this, stackSize, HTTP_SERVER_IDLE_TIMEOUT, serverIP, serverPort, firewallCallback, runAsReactor ? __webConnectionEventHandler__ : NULL, workerPoolSize, acceptQueueLength, overflowPolicy)
                                 {
+                                  #if HTTP_SERVER_RESPONSE_CACHE_ENTRIES > 0
+                                    if (__responseCacheRendered__) xEventGroupSetBits (__responseCacheRendered__, (1 << HTTP_SERVER_RESPONSE_CACHE_ENTRIES) - 1); // nobody is rendering into any slot yet
+                                  #endif
                                   __externalHttpRequestHandler__ = httpRequestHandler;
                                   __externalWsRequestHandler__ = wsRequestHandler; 
                                   __webServerHomeDirectory__ = getUserHomeDirectory ("webserver"); 
@@ -469,110 +960,1828 @@ readingPayload:
                                     webDmesg ("[httpServer] home directory for webserver system account is not set.");
                                     return;
                                   }
+                                  #ifdef __FILE_SYSTEM__
+                                    addFileChangeListener (__fileChanged__, this); // count file writes (see __validators__) and drop files from file cache when they get changed through FTP, telnet, writeFile, ...
+                                  #endif
                                   __started__ = true; // we have initialized everything needed for TCP connection
-                                  if (started ()) webDmesg ("[httpServer] started on " + String (serverIP) + ":" + String (serverPort) + (firewallCallback ? " with firewall." : "."));
+                                  if (started ()) webDmesg ("[httpServer] started on " + String (serverIP) + ":" + String (serverPort) + (runAsReactor ? " as reactor" : (workerPoolSize ? " with " + String (workerPoolSize) + " worker threads" : "")) + (firewallCallback ? " with firewall." : "."));
                                 }
       
-      ~httpServer ()            { if (started ()) webDmesg ("[httpServer] stopped."); }
+      ~httpServer ()            { 
+                                  bool wasStarted = started ();
+                                  if (__eventStreamMutex__) { // wake up event stream subscribers so they leave at once
+                                    xSemaphoreTake (__eventStreamMutex__, portMAX_DELAY);
+                                      __eventStreamsClosing__ = true;
+                                      for (__eventSubscriber__ *s = __eventSubscriberList__; s; s = s->next) xTaskNotifyGive (s->task);
+                                    xSemaphoreGive (__eventStreamMutex__);
+                                  }
+                                  stop (); // no connection may use routes, sessions, caches, ... any more when they get freed below
+                                  if (wasStarted) webDmesg ("[httpServer] stopped."); 
+                                  #ifdef __FILE_SYSTEM__
+                                    removeFileChangeListener (__fileChanged__, this);
+                                    #if HTTP_SERVER_FILE_CACHE_SIZE > 0
+                                      __fileChanged__ ("/", this); // drop all cached files
+                                    #endif
+                                  #endif
+                                  if (__routeNode__) {
+                                    for (int i = 0; i < __routeNodeCount__; i++) if (__routeNode__ [i].parameterName) free (__routeNode__ [i].parameterName);
+                                    for (int i = 0; i < __HTTP_ROUTE_HASH_SIZE__; i++) if (__routeEdge__ [i].segment) free (__routeEdge__ [i].segment);
+                                    free (__routeNode__);
+                                    free (__routeEdge__);
+                                  }
+                                  if (__routeMutex__) vSemaphoreDelete (__routeMutex__);
+                                  if (__sessions__) free (__sessions__);
+                                  for (int i = 0; i < HTTP_SERVER_EVENT_QUEUE_LENGTH; i++) if (__eventQueue__ [i]) free (__eventQueue__ [i]);
+                                  if (__eventStreamMutex__) vSemaphoreDelete (__eventStreamMutex__);
+                                  #ifdef __FILE_SYSTEM__
+                                    if (__accessLog__) {
+                                      __accessLogRunning__ = false;
+                                      while (!__accessLogFinished__) delay (10); // let the background task write the last records
+                                      free (__accessLog__);
+                                    }
+                                  #endif
+                                  #if HTTP_SERVER_RESPONSE_CACHE_ENTRIES > 0
+                                    for (int i = 0; i < HTTP_SERVER_RESPONSE_CACHE_ENTRIES; i++) if (__responseCacheSlot__ [i].response) free (__responseCacheSlot__ [i].response);
+                                    if (__responseCacheRendered__) vEventGroupDelete (__responseCacheRendered__);
+                                  #endif
+                                }
       
       bool started ()           { return TcpServer::started () && __started__; } 
 
       String getHomeDirectory () { return __webServerHomeDirectory__; }
 
+      // HTTP/1.1 connections are persistent unless the client sends Connection: close (HTTP/1.0 connections only if the client sends 
+      // Connection: keep-alive). Connection that stays idle for idleTimeoutMillis or has served maxRequestsPerConnection requests (0 
+      // for no limit) is closed, so it doesn't hold ESP32 resources forever. The settings apply to connections that arrive later.
+      void setKeepAlive (unsigned long idleTimeoutMillis, unsigned int maxRequestsPerConnection) {
+        portENTER_CRITICAL (&csTcpConnectionInternalStructure); // listener, workers and connections read them while the server is running
+          __timeOutMillis__ = idleTimeoutMillis;
+          __maxRequestsPerConnection__ = maxRequestsPerConnection;
+        portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+      }
+
+      // web sessions: after the user has been authenticated once (with checkUserNameAndPassword) openSession returns a random token that is sent
+      // to the browser in sessionToken cookie, the following requests are then checked with getSessionUserName in constant time without any 
+      // file I/O. The session expires when it is not used for HTTP_SERVER_SESSION_TIMEOUT seconds.
+      String openSession (String userName) { // returns session token or "" if the session couldn't be opened
+        if (userName == "" || userName.length () > USER_PASSWORD_MAX_LENGTH) return "";
+        if (!__sessions__) {
+          __session__ *sessions = (__session__ *) malloc (sizeof (__session__) * __HTTP_SESSION_HASH_SIZE__); // the table only takes memory if sessions are used
+          if (!sessions) {
+            webDmesg ("[httpServer] can't get heap memory for web sessions.");
+            return "";
+          }
+          memset (sessions, 0, sizeof (__session__) * __HTTP_SESSION_HASH_SIZE__);
+          portENTER_CRITICAL (&__csSessions__);
+            if (!__sessions__) { __sessions__ = sessions; sessions = NULL; }
+          portEXIT_CRITICAL (&__csSessions__);
+          if (sessions) free (sessions); // another thread was faster
+        }
+        char token [33];
+        sprintf (token, "%08x%08x%08x%08x", esp_random (), esp_random (), esp_random (), esp_random ()); // 128 bits of ESP32 hardware random number generator (true random while WiFi is running)
+        unsigned long now = millis ();
+        portENTER_CRITICAL (&__csSessions__);
+          // make room: drop expired sessions, user's sessions above HTTP_SERVER_MAX_SESSIONS_PER_USER and, if the table is still full, the least recently active session
+          for (int i = 0; i < __HTTP_SESSION_HASH_SIZE__; i++)
+            if (*__sessions__ [i].token && now - __sessions__ [i].lastActiveMillis > HTTP_SERVER_SESSION_TIMEOUT * 1000UL && __removeSession__ (i)) i --; // the next session has been shifted into i
+          int usersSessions = 0, usersOldest = -1, oldest = -1;
+          for (int i = 0; i < __HTTP_SESSION_HASH_SIZE__; i++) {
+            if (!*__sessions__ [i].token) continue;
+            if (!strcmp (__sessions__ [i].userName, userName.c_str ())) { usersSessions ++; if (usersOldest < 0 || __sessions__ [i].lastActiveMillis - __sessions__ [usersOldest].lastActiveMillis > 0x7FFFFFFF) usersOldest = i; }
+            if (oldest < 0 || __sessions__ [i].lastActiveMillis - __sessions__ [oldest].lastActiveMillis > 0x7FFFFFFF) oldest = i;
+          }
+          if (usersSessions >= HTTP_SERVER_MAX_SESSIONS_PER_USER) __removeSession__ (usersOldest);
+          else if (__sessionCount__ >= HTTP_SERVER_SESSION_CAPACITY) __removeSession__ (oldest);
+          int i = __sessionHash__ (token);
+          while (*__sessions__ [i].token) i = (i + 1) & (__HTTP_SESSION_HASH_SIZE__ - 1); // linear probing
+          strcpy (__sessions__ [i].token, token);
+          strcpy (__sessions__ [i].userName, userName.c_str ());
+          __sessions__ [i].lastActiveMillis = now;
+          __sessionCount__ ++;
+        portEXIT_CRITICAL (&__csSessions__);
+        return String (token);
+      }
+
+      String getSessionUserName (String token) { return __sessionUserName__ (token.c_str (), token.length ()); } // returns the user name of the session (and prolongs it) or "" if there is no such session or it has expired
+
+      bool closeSession (String token) { // logout, returns false if there is no such session
+        if (!__sessions__) return false;
+        portENTER_CRITICAL (&__csSessions__);
+          int i = __findSession__ (token.c_str (), token.length ());
+          if (i >= 0) __removeSession__ (i);
+        portEXIT_CRITICAL (&__csSessions__);
+        return i >= 0;
+      }
+
+      int closeUserSessions (String userName) { // closes all sessions of the user (when the user's password changes, for example), returns the number of sessions closed
+        if (!__sessions__) return 0;
+        int closed = 0;
+        portENTER_CRITICAL (&__csSessions__);
+          for (int i = 0; i < __HTTP_SESSION_HASH_SIZE__; i++)
+            if (*__sessions__ [i].token && !strcmp (__sessions__ [i].userName, userName.c_str ())) { closed ++; if (__removeSession__ (i)) i --; }
+        portEXIT_CRITICAL (&__csSessions__);
+        return closed;
+      }
+
+      String getStatistics ()   { // returns statistics gathered since the server started (or since resetStatistics was called) in json format
+                                  unsigned long connections, requests, reusedConnectionRequests, bytesSent, bytesReceived, latencyHistogram [HTTP_SERVER_LATENCY_HISTOGRAM_SIZE];
+                                  portENTER_CRITICAL (&__csStatistics__);
+                                    connections = __connectionCount__;
+                                    requests = __requestCount__;
+                                    reusedConnectionRequests = __reusedConnectionRequestCount__;
+                                    bytesSent = __bytesSent__;
+                                    bytesReceived = __bytesReceived__;
+                                    memcpy (latencyHistogram, __latencyHistogram__, sizeof (latencyHistogram));
+                                  portEXIT_CRITICAL (&__csStatistics__);
+                                  float seconds = (float) (millis () - __statisticsStartMillis__) / 1000; if (seconds < 1) seconds = 1;
+                                  return "{\"connections\":" + String (connections) + 
+                                         ",\"requests\":" + String (requests) + 
+                                         ",\"requestsPerSecond\":" + String ((float) requests / seconds) + 
+                                         ",\"connectionReuse\":" + String (requests ? (float) reusedConnectionRequests / requests : 0) + // the share of requests that came over an already used (persistent) connection
+                                         ",\"bytesSent\":" + String (bytesSent) + 
+                                         ",\"bytesSentPerSecond\":" + String ((float) bytesSent / seconds) + 
+                                         ",\"bytesReceived\":" + String (bytesReceived) + 
+                                         ",\"rateLimitRejections\":" + String (getRateLimitRejections ()) +
+                                         ",\"latencyMicros\":{\"p50\":" + String (__latencyPercentile__ (latencyHistogram, requests, 500)) + ",\"p99\":" + String (__latencyPercentile__ (latencyHistogram, requests, 990)) + ",\"p999\":" + String (__latencyPercentile__ (latencyHistogram, requests, 999)) + "}" +
+                                         #if defined (__FILE_SYSTEM__) && HTTP_SERVER_FILE_CACHE_SIZE > 0
+                                           __fileCacheStatistics__ () +
+                                         #endif
+                                         #if HTTP_SERVER_RESPONSE_CACHE_ENTRIES > 0
+                                           __responseCacheStatistics__ () +
+                                         #endif
+                                         #ifdef __FILE_SYSTEM__
+                                           __accessLogStatistics__ () +
+                                         #endif
+                                         ",\"freeHeap\":" + String (ESP.getFreeHeap ()) + 
+                                         ",\"minFreeHeap\":" + String (ESP.getMinFreeHeap ()) + "}";
+                                }
+
+      typedef String (*httpRouteHandler) (String& httpRequest, httpServer::wwwSessionParameters *wsp);
+      typedef void (*httpStreamingRouteHandler) (String& httpRequest, httpServer::wwwSessionParameters *wsp, httpServer::httpResponseWriter *response);
+
+      // Routes are tried after httpRequestHandler returns "" and before the files in home directory. Path pattern is made of segments
+      // separated by '/', a segment in {braces} is a parameter that matches any one segment of HTTP request path, for example:
+      // addRoute ("PUT", "/niceSlider3/{value}", ...) and then wsp->getHttpRequestPathParameter ("value") in route handler.
+      // Routes are kept in a trie with path segments hashed, so finding the route doesn't take longer when more routes are added.
+      // Routes may be added while the server is already running. Route handler may return "" to let httpServer handle the request internally.
+      // Streaming route handler writes its reply through httpResponseWriter instead of returning it (see httpResponseWriter).
+      // GET route may give its replies a time-to-live (cacheMillis): a reply (with the header fields route handler has set) is then kept
+      // and sent to all the requests for the same path and query that arrive within cacheMillis, while only one of them calls route 
+      // handler again when it expires - the others wait for its reply. Use it for replies that are the same for every client.
+      bool addRoute (const char *method, const char *pathPattern, httpRouteHandler routeHandler, unsigned long cacheMillis = 0) { // returns success
+        if (!__routeMutex__) return false;
+        int m, node;
+        xSemaphoreTake (__routeMutex__, portMAX_DELAY); // requests may be looking for their routes meanwhile
+          bool added = __addRoutePath__ (method, pathPattern, &m, &node);
+          if (added) {
+            __routeNode__ [node].handler [m].reply = routeHandler;
+            __routeNode__ [node].streaming &= ~(1 << m);
+            if (m == 0) __routeNode__ [node].cacheMillis = cacheMillis; // only GET replies are cached
+          }
+        xSemaphoreGive (__routeMutex__);
+        return added;
+      }
+
+      bool addRoute (const char *method, const char *pathPattern, httpStreamingRouteHandler routeHandler) { // returns success
+        if (!__routeMutex__) return false;
+        int m, node;
+        xSemaphoreTake (__routeMutex__, portMAX_DELAY);
+          bool added = __addRoutePath__ (method, pathPattern, &m, &node);
+          if (added) {
+            __routeNode__ [node].handler [m].stream = routeHandler;
+            __routeNode__ [node].streaming |= 1 << m;
+          }
+        xSemaphoreGive (__routeMutex__);
+        return added;
+      }
+
+      // Server-Sent Events: GET request for event stream path gets text/event-stream reply that doesn't end, the events publishEvent 
+      // publishes to this path are pushed through it (in browser: new EventSource ('/events').addEventListener ('eventName', ...)). Each 
+      // subscriber holds its connection and a thread (in reactor mode a thread of its own, like WebSockets) until it disconnects. Event
+      // streams are tried after httpRequestHandler and routes, so httpRequestHandler may still refuse the request (login, firewall, ...).
+      // Event streams may be added while the server is already running (publishTo is usually called after httpServer has started).
+      bool addEventStream (const char *path) { // returns success
+        if (!__eventStreamMutex__) return false;
+        xSemaphoreTake (__eventStreamMutex__, portMAX_DELAY); // only one addEventStream at a time, so __eventStreamCount__ doesn't change under our hands
+          int count = __eventStreamCount__;
+          for (int i = 0; i < count; i++) if (__eventStreamPath__ [i] == path) { xSemaphoreGive (__eventStreamMutex__); return true; }
+          if (count == HTTP_SERVER_MAX_EVENT_STREAMS) { xSemaphoreGive (__eventStreamMutex__); webDmesg ("[httpServer] too many event streams, increase HTTP_SERVER_MAX_EVENT_STREAMS."); return false; }
+          __eventStreamPath__ [count] = path; // the other threads don't look at this slot before __eventStreamCount__ gets increased, the paths already there never change
+          portENTER_CRITICAL (&__csEvents__);
+            __eventStreamCount__ = count + 1;
+          portEXIT_CRITICAL (&__csEvents__);
+        xSemaphoreGive (__eventStreamMutex__);
+        return true;
+      }
+
+      bool hasEventSubscribers (const char *path) { // cheap check, so that the publisher doesn't have to build event data nobody would get
+        int stream = __findEventStream__ (path);
+        if (stream < 0) return false;
+        portENTER_CRITICAL (&__csEvents__);
+          int subscribers = __eventSubscribers__ [stream];
+        portEXIT_CRITICAL (&__csEvents__);
+        return subscribers > 0;
+      }
+
+      bool publishEvent (const char *path, String eventName, String data) { // pushes event to all current subscribers of event stream path, returns false if the event couldn't be published
+        int stream = __findEventStream__ (path);
+        if (stream < 0) return false;
+        portENTER_CRITICAL (&__csEvents__);
+          int subscribers = __eventSubscribers__ [stream];
+        portEXIT_CRITICAL (&__csEvents__);
+        if (!subscribers) return true; // nobody would get it
+        // event:eventName\ndata:line 1\ndata:line 2\n...id:n\n\n - id gets appended when the event is put into the queue
+        String text = "event:" + eventName + "\n";
+        for (int i = 0; i <= (int) data.length (); ) {
+          int e = data.indexOf ('\n', i); if (e < 0) e = data.length ();
+          int l = e; if (l > i && data [l - 1] == '\r') l --;
+          if (l > i || e < (int) data.length ()) text += "data:" + data.substring (i, l) + "\n"; // the last (empty) line after \r\n is not a line
+          i = e + 1;
+        }
+        __event__ *ev = (__event__ *) malloc (sizeof (__event__) + text.length () + 16); // + id:4294967295\n\n
+        if (!ev) return false;
+        memcpy (ev->text (), text.c_str (), text.length ());
+        ev->stream = stream;
+        ev->references = 1; // the queue's reference
+        portENTER_CRITICAL (&__csEvents__);
+          ev->id = ++ __lastEventId__;
+          char *p = ev->text () + text.length ();
+          p += sprintf (p, "id:%lu\n\n", ev->id);
+          ev->length = p - ev->text ();
+          __event__ *dropped = __eventQueue__ [ev->id % HTTP_SERVER_EVENT_QUEUE_LENGTH]; // the oldest event
+          __eventQueue__ [ev->id % HTTP_SERVER_EVENT_QUEUE_LENGTH] = ev;
+        portEXIT_CRITICAL (&__csEvents__);
+        if (dropped) __releaseEvent__ (dropped);
+        xSemaphoreTake (__eventStreamMutex__, portMAX_DELAY); // wake up the subscribers of this stream, the mutex keeps them from leaving the list (and their threads from ending) meanwhile
+          for (__eventSubscriber__ *s = __eventSubscriberList__; s; s = s->next) if (s->stream == stream) xTaskNotifyGive (s->task);
+        xSemaphoreGive (__eventStreamMutex__);
+        return true;
+      }
+
+      // Files in directory (relative to web server home directory, like "/" or "/images/") and its subdirectories will be sent with
+      // Cache-Control header field, for example setCacheControl ("/images/", "max-age=86400") or setCacheControl ("/", "no-cache").
+      // The deepest directory that matches the file is used. Files always get ETag and Last-Modified validators so browsers can
+      // revalidate them with conditional GET and get 304 Not modified reply if they already have the current version.
+      bool setCacheControl (String directory, String cacheControl) { // returns success
+        if (!directory.startsWith ("/")) directory = "/" + directory;
+        if (!directory.endsWith ("/")) directory += "/";
+        directory = __webServerHomeDirectory__ + directory.substring (1);
+        int i;
+        for (i = 0; i < __cacheControlCount__ && __cacheControlDirectory__ [i] != directory; i++);
+        if (i == HTTP_SERVER_MAX_CACHE_CONTROL_DIRECTORIES) { webDmesg ("[httpServer] too many Cache-Control directories, increase HTTP_SERVER_MAX_CACHE_CONTROL_DIRECTORIES."); return false; }
+        __cacheControlDirectory__ [i] = directory;
+        __cacheControl__ [i] = cacheControl;
+        if (i == __cacheControlCount__) __cacheControlCount__ ++;
+        return true;
+      }
+
+      #ifdef __FILE_SYSTEM__
+        // Allows files in directory (relative to web server home directory, like "/upload/" or "/") and its subdirectories to be created
+        // or replaced with PUT requests, like curl -T file.html http://esp32/upload/file.html. Uploads are not allowed by default, since 
+        // httpServer doesn't know who is allowed to make them - httpRequestHandler (or a route) should check that before returning "".
+        void setUploadDirectory (String directory) {
+          if (!directory.startsWith ("/")) directory = "/" + directory;
+          if (!directory.endsWith ("/")) directory += "/";
+          __uploadDirectory__ = __webServerHomeDirectory__ + directory.substring (1);
+        }
+
+        // Access log: time, client IP, method, path, status, bytes sent and duration (in microseconds) of each request are recorded in a ring in
+        // RAM, from where a background task appends them to fileName in large blocks - request handling never waits for FFat. When the file
+        // gets larger than maxFileSize it is renamed to fileName.1 (replacing the previous one). If the records arrive faster than they can
+        // be written, the ones that don't fit into the ring are dropped and counted (see getStatistics).
+        bool startAccessLog (String fileName = "/var/log/httpd.log", size_t maxFileSize = HTTP_SERVER_ACCESS_LOG_MAX_FILE_SIZE) { // returns success
+          if (__accessLog__) return false; // already started
+          int i = fileName.lastIndexOf ('/');
+          if (i > 0 && !isDirectory (fileName.substring (0, i))) FFat.mkdir (fileName.substring (0, i)); // like /var/log
+          __accessLogFileName__ = fileName;
+          __accessLogMaxFileSize__ = maxFileSize;
+          __accessLogRecord__ *ring = (__accessLogRecord__ *) calloc (HTTP_SERVER_ACCESS_LOG_RING_SIZE, sizeof (__accessLogRecord__));
+          if (!ring) { webDmesg ("[httpServer] can't get heap memory for access log."); return false; }
+          __accessLogRunning__ = true;
+          if (pdPASS != xTaskCreate (__accessLogTask__, "httpAccessLog", 4 * 1024, this, tskNORMAL_PRIORITY, NULL)) {
+            __accessLogRunning__ = false;
+            free (ring);
+            webDmesg ("[httpServer] can't start access log thread.");
+            return false;
+          }
+          __accessLog__ = ring; // requests start being recorded from now on
+          return true;
+        }
+      #endif
+
+      void resetStatistics ()   {
+                                  portENTER_CRITICAL (&__csStatistics__);
+                                    __connectionCount__ = __requestCount__ = __reusedConnectionRequestCount__ = __bytesSent__ = __bytesReceived__ = 0;
+                                    memset (__latencyHistogram__, 0, sizeof (__latencyHistogram__));
+                                    __statisticsStartMillis__ = millis ();
+                                  portEXIT_CRITICAL (&__csStatistics__);
+                                  portENTER_CRITICAL (&__csRateLimit__);
+                                    __rateLimitRejections__ = 0;
+                                  portEXIT_CRITICAL (&__csRateLimit__);
+                                  #if defined (__FILE_SYSTEM__) && HTTP_SERVER_FILE_CACHE_SIZE > 0
+                                    portENTER_CRITICAL (&__csFileCache__);
+                                      __fileCacheHits__ = __fileCacheMisses__ = __fileCacheBytesServed__ = 0;
+                                    portEXIT_CRITICAL (&__csFileCache__);
+                                  #endif
+                                  #if HTTP_SERVER_RESPONSE_CACHE_ENTRIES > 0
+                                    portENTER_CRITICAL (&__csResponseCache__);
+                                      __responseCacheHits__ = __responseCacheMisses__ = 0;
+                                    portEXIT_CRITICAL (&__csResponseCache__);
+                                  #endif
+                                }
+
     private:
 
       String (*__externalHttpRequestHandler__) (String& httpRequest, httpServer::wwwSessionParameters *wsp);  // httpRequestHandler callback function provided by calling program
+      unsigned int __maxRequestsPerConnection__ = HTTP_SERVER_MAX_REQUESTS_PER_CONNECTION;
       void (*__externalWsRequestHandler__) (String& wsRequest, WebSocket *webSocket);                         // wsRequestHandler callback function provided by calling program
       String __webServerHomeDirectory__ = "";                                                                 // webServer system account home directory
       bool __started__ = false;
 
+      // routes
+      struct __routeNodeType__ {
+        union {
+          httpRouteHandler reply;
+          httpStreamingRouteHandler stream;
+        } handler [__HTTP_METHOD_COUNT__];                  // for each HTTP method
+        uint8_t streaming;                                  // bit for each HTTP method: handler is httpStreamingRouteHandler
+        unsigned long cacheMillis;                          // time-to-live of GET replies, 0 if they are not cached
+        int16_t parameterChild;                             // node that {parameter} segment leads to or -1
+        char *parameterName;
+      };
+      struct __routeEdgeType__ {                            // hash table entry: static path segment that leads from parent node to child node
+        int16_t parent;
+        int16_t child;                                      // 0 for empty slot (root node is nobody's child)
+        uint16_t segmentLength;
+        char *segment;
+      };
+      __routeNodeType__ *__routeNode__ = NULL;              // allocated when the first route is added
+      __routeEdgeType__ *__routeEdge__ = NULL;
+      int __routeNodeCount__ = 0;
+      SemaphoreHandle_t __routeMutex__ = xSemaphoreCreateMutex (); // addRoute changes the trie while holding it, requests hold it while looking for their route (but not while route handler runs)
+
+      static int __methodIndex__ (const char *method, int length) {
+        static const char *methods [__HTTP_METHOD_COUNT__] = {"GET", "POST", "PUT", "DELETE", "HEAD", "PATCH", "OPTIONS"};
+        for (int i = 0; i < __HTTP_METHOD_COUNT__; i++) if ((int) strlen (methods [i]) == length && !strncmp (methods [i], method, length)) return i;
+        return -1;
+      }
+
+      static unsigned int __routeHash__ (int parent, const char *segment, int length) { // FNV-1a of segment, combined with parent node
+        unsigned int h = 2166136261 ^ (parent * 2654435761u);
+        for (int i = 0; i < length; i++) h = (h ^ (uint8_t) segment [i]) * 16777619;
+        return h;
+      }
+
+      int __findRouteEdge__ (int parent, const char *segment, int length) { // returns child node or -1
+        for (int slot = __routeHash__ (parent, segment, length) & (__HTTP_ROUTE_HASH_SIZE__ - 1); __routeEdge__ [slot].child; slot = (slot + 1) & (__HTTP_ROUTE_HASH_SIZE__ - 1))
+          if (__routeEdge__ [slot].parent == parent && __routeEdge__ [slot].segmentLength == length && !strncmp (__routeEdge__ [slot].segment, segment, length)) return __routeEdge__ [slot].child;
+        return -1;
+      }
+
+      int __newRouteNode__ () {
+        if (__routeNodeCount__ == HTTP_SERVER_MAX_ROUTE_NODES) { webDmesg ("[httpServer] too many routes, increase HTTP_SERVER_MAX_ROUTE_NODES."); return -1; }
+        __routeNode__ [__routeNodeCount__].parameterChild = -1;
+        return __routeNodeCount__ ++;
+      }
+
+      bool __addRoutePath__ (const char *method, const char *pathPattern, int *m, int *routeNode) { // adds nodes for path pattern, returns method index and the last node
+        *m = __methodIndex__ (method, strlen (method));
+        if (*m < 0 || *pathPattern != '/') { webDmesg ("[httpServer] invalid route " + String (method) + " " + String (pathPattern)); return false; }
+        if (!__routeNode__) { // the first route
+          __routeNode__ = (__routeNodeType__ *) calloc (HTTP_SERVER_MAX_ROUTE_NODES, sizeof (__routeNodeType__));
+          __routeEdge__ = (__routeEdgeType__ *) calloc (__HTTP_ROUTE_HASH_SIZE__, sizeof (__routeEdgeType__));
+          if (!__routeNode__ || !__routeEdge__) { 
+            if (__routeNode__) free (__routeNode__); 
+            if (__routeEdge__) free (__routeEdge__); 
+            __routeNode__ = NULL; __routeEdge__ = NULL;
+            webDmesg ("[httpServer] not enough memory for routes."); 
+            return false; 
+          }
+          __routeNode__ [0].parameterChild = -1;
+          __routeNodeCount__ = 1; // root node
+        }
+        int node = 0;
+        const char *segment = pathPattern + 1;
+        int parameters = 0;
+        if (*segment) while (true) {
+          const char *e = strchr (segment, '/'); if (!e) e = segment + strlen (segment);
+          int segmentLength = e - segment;
+          int child;
+          if (segmentLength >= 2 && *segment == '{' && *(e - 1) == '}') { // {parameter}
+            if (++ parameters > HTTP_SERVER_MAX_PATH_PARAMETERS) { webDmesg ("[httpServer] too many parameters in route " + String (pathPattern)); return false; }
+            if ((child = __routeNode__ [node].parameterChild) < 0) {
+              if ((child = __newRouteNode__ ()) < 0) return false;
+              __routeNode__ [node].parameterChild = child;
+              __routeNode__ [node].parameterName = strndup (segment + 1, segmentLength - 2);
+            } else if (strlen (__routeNode__ [node].parameterName) != (size_t) segmentLength - 2 || strncmp (__routeNode__ [node].parameterName, segment + 1, segmentLength - 2)) {
+              webDmesg ("[httpServer] route " + String (pathPattern) + " conflicts with the routes already added."); // the same position in path may only have one parameter name
+              return false;
+            }
+          } else { // static segment
+            if ((child = __findRouteEdge__ (node, segment, segmentLength)) < 0) {
+              if ((child = __newRouteNode__ ()) < 0) return false;
+              int slot = __routeHash__ (node, segment, segmentLength) & (__HTTP_ROUTE_HASH_SIZE__ - 1);
+              while (__routeEdge__ [slot].child) slot = (slot + 1) & (__HTTP_ROUTE_HASH_SIZE__ - 1); // there are twice as many slots as nodes so a free slot can always be found
+              __routeEdge__ [slot] = {(int16_t) node, (int16_t) child, (uint16_t) segmentLength, strndup (segment, segmentLength)};
+            }
+          }
+          node = child;
+          if (!*e) break;
+          segment = e + 1;
+        }
+        *routeNode = node;
+        return true;
+      }
+
+      enum __routeResultType__ {
+        NOT_ROUTED,                                         // no route matches, the request is handled internally
+        ROUTE_REPLIED,                                      // route handler returned the reply that still has to be sent
+        ROUTE_STREAMED,                                     // streaming route handler has already sent the reply
+        ROUTE_STREAMED_AND_CLOSE                            // the same but the connection must be closed (HTTP/1.0 client or connection error)
+      };
+
+      int __findRoute__ (String& httpRequest, wwwSessionParameters *wsp) { // returns the node that matches HTTP request path or -1, call it while holding __routeMutex__
+        httpField path = wsp->getHttpRequestPath ();
+        if (!path.length || *path.value != '/') return -1;
+        int node = 0;
+        const char *segment = path.value + 1;
+        const char *pathEnd = path.value + path.length;
+        if (segment < pathEnd) while (true) {
+          const char *e = (const char *) memchr (segment, '/', pathEnd - segment); if (!e) e = pathEnd;
+          int child = __findRouteEdge__ (node, segment, e - segment); // static segments take precedence over {parameters}
+          if (child < 0) {
+            if ((child = __routeNode__ [node].parameterChild) < 0) return -1;
+            wsp->__pathParameter__ [wsp->__pathParameterCount__ ++] = {__routeNode__ [node].parameterName, {(uint16_t) (segment - httpRequest.c_str ()), (uint16_t) (e - segment)}}; // parameter names are never freed while the server runs
+          }
+          node = child;
+          if (e == pathEnd) break;
+          segment = e + 1;
+        }
+        return node;
+      }
+
+      __routeResultType__ __dispatchRoute__ (String& httpRequest, wwwSessionParameters *wsp, String& httpResponseContent) { // calls route handler that matches HTTP request
+        if (!__routeNode__) return NOT_ROUTED; // no routes (yet)
+        httpField method = wsp->getHttpRequestMethod ();
+        int m = __methodIndex__ (method.value, method.length);
+        if (m < 0) return NOT_ROUTED;
+        // copy what is needed from the trie, route handler is called after the mutex is given back
+        xSemaphoreTake (__routeMutex__, portMAX_DELAY);
+          int node = __findRoute__ (httpRequest, wsp);
+          bool streaming = node >= 0 && (__routeNode__ [node].streaming & (1 << m));
+          httpRouteHandler reply = node >= 0 ? __routeNode__ [node].handler [m].reply : NULL;
+          httpStreamingRouteHandler stream = node >= 0 ? __routeNode__ [node].handler [m].stream : NULL;
+          unsigned long cacheMillis = node >= 0 ? __routeNode__ [node].cacheMillis : 0;
+        xSemaphoreGive (__routeMutex__);
+        if (streaming) {
+          httpResponseWriter response (wsp);
+          stream (httpRequest, wsp, &response);
+          return response.__finish__ () ? ROUTE_STREAMED : ROUTE_STREAMED_AND_CLOSE;
+        }
+        if (!reply) return NOT_ROUTED;
+        #if HTTP_SERVER_RESPONSE_CACHE_ENTRIES > 0
+          if (m == 0 && cacheMillis) return __dispatchCachedRoute__ (httpRequest, wsp, httpResponseContent, reply, cacheMillis);
+        #endif
+        return (httpResponseContent = reply (httpRequest, wsp)) != "" ? ROUTE_REPLIED : NOT_ROUTED;
+      }
+
+      #if HTTP_SERVER_RESPONSE_CACHE_ENTRIES > 0
+
+        // response cache: route replies that are still within their time-to-live, key is HTTP request path with query
+        struct __cachedResponse__ {                         // key, header fields and content follow this header in the same block of heap
+          int references;                                   // the cache holds one reference while the reply is in its slot, each request that is being served from it holds another one
+          unsigned long renderedMillis;
+          size_t keyLength;
+          size_t headerFieldsLength;
+          char *key () { return (char *) (this + 1); }
+          char *headerFields () { return key () + keyLength + 1; }
+          char *content () { return headerFields () + headerFieldsLength + 1; }
+        };
+        struct __responseCacheSlotType__ {
+          unsigned int hash;                                // of key
+          bool rendering;                                   // some thread is calling route handler for this key, the others should wait for its reply
+          unsigned long lastUsedMillis;                     // the least recently used slot is reused when all are occupied
+          __cachedResponse__ *response;                     // NULL while (or if) nothing is cached
+        };
+        portMUX_TYPE __csResponseCache__ = portMUX_INITIALIZER_UNLOCKED;
+        __responseCacheSlotType__ __responseCacheSlot__ [HTTP_SERVER_RESPONSE_CACHE_ENTRIES] = {};
+        unsigned long __responseCacheHits__ = 0;
+        unsigned long __responseCacheMisses__ = 0;
+        EventGroupHandle_t __responseCacheRendered__ = xEventGroupCreate (); // bit i is cleared while some thread is rendering into slot i, the threads waiting for its reply wait for the bit to be set again
+
+        void __releaseCachedResponse__ (__cachedResponse__ *c) {
+          portENTER_CRITICAL (&__csResponseCache__);
+            bool unused = !-- c->references;
+          portEXIT_CRITICAL (&__csResponseCache__);
+          if (unused) free (c); // it has already been replaced or dropped from the cache
+        }
+
+        __routeResultType__ __dispatchCachedRoute__ (String& httpRequest, wwwSessionParameters *wsp, String& httpResponseContent, httpRouteHandler reply, unsigned long cacheMillis) { // like __dispatchRoute__ but the reply may come from response cache
+          httpField path = wsp->getHttpRequestPath ();
+          httpField query = wsp->getHttpRequestQuery ();
+          const char *key = path.value;
+          size_t keyLength = query.length ? query.value + query.length - key : path.length; // path and query are one after another in HTTP request
+          unsigned int hash = 2166136261;
+          for (size_t i = 0; i < keyLength; i++) hash = (hash ^ (uint8_t) key [i]) * 16777619; // FNV-1a
+
+          // find the cached reply or become the thread that calls route handler for this key (single-flight)
+          int slot;
+          __cachedResponse__ *c;
+          while (true) {
+            c = NULL;
+            __cachedResponse__ *dropped = NULL;
+            bool wait = false;
+            unsigned long now = millis ();
+            portENTER_CRITICAL (&__csResponseCache__);
+              for (slot = 0; slot < HTTP_SERVER_RESPONSE_CACHE_ENTRIES; slot++) {
+                __responseCacheSlotType__ *r = &__responseCacheSlot__ [slot];
+                if (r->hash == hash && (r->rendering || (r->response && r->response->keyLength == keyLength && !memcmp (r->response->key (), key, keyLength)))) break;
+              }
+              if (slot < HTTP_SERVER_RESPONSE_CACHE_ENTRIES && __responseCacheSlot__ [slot].rendering) {
+                wait = true;
+              } else if (slot < HTTP_SERVER_RESPONSE_CACHE_ENTRIES && now - __responseCacheSlot__ [slot].response->renderedMillis < cacheMillis) {
+                c = __responseCacheSlot__ [slot].response; // still fresh
+                c->references ++;
+                __responseCacheSlot__ [slot].lastUsedMillis = now;
+                __responseCacheHits__ ++;
+              } else {
+                if (slot == HTTP_SERVER_RESPONSE_CACHE_ENTRIES) { // not cached yet, take an empty or the least recently used slot that nobody is rendering into
+                  int lru = -1;
+                  for (slot = 0; slot < HTTP_SERVER_RESPONSE_CACHE_ENTRIES; slot++) {
+                    __responseCacheSlotType__ *r = &__responseCacheSlot__ [slot];
+                    if (!r->rendering && !r->response) break;
+                    if (!r->rendering && (lru < 0 || now - r->lastUsedMillis > now - __responseCacheSlot__ [lru].lastUsedMillis)) lru = slot;
+                  }
+                  if (slot == HTTP_SERVER_RESPONSE_CACHE_ENTRIES) slot = lru; // -1 if all slots are being rendered into, the reply then just doesn't get cached
+                }
+                if (slot >= 0) {
+                  dropped = __responseCacheSlot__ [slot].response;
+                  __responseCacheSlot__ [slot] = {hash, true, now, NULL};
+                }
+                __responseCacheMisses__ ++;
+              }
+            portEXIT_CRITICAL (&__csResponseCache__);
+            if (dropped) __releaseCachedResponse__ (dropped);
+            if (slot >= 0 && !wait && !c && __responseCacheRendered__) xEventGroupClearBits (__responseCacheRendered__, 1 << slot); // this thread is rendering into the slot now
+            if (!wait) break;
+            // another thread is calling route handler for the same key, wait until its reply is ready, but not forever - if route handler takes too long call it here as well and don't cache the reply
+            // (a waiting thread may also come here just before the rendering thread clears the bit, it then only goes round the loop once more)
+            if (!__responseCacheRendered__ || !(xEventGroupWaitBits (__responseCacheRendered__, 1 << slot, pdFALSE, pdTRUE, pdMS_TO_TICKS (HTTP_SERVER_RESPONSE_CACHE_WAIT)) & (1 << slot))) {
+              slot = -1;
+              break;
+            }
+          }
+
+          if (c) { // send cached reply
+            wsp->httpResponseHeaderFields += c->headerFields ();
+            httpResponseContent = c->content ();
+            __releaseCachedResponse__ (c);
+            return ROUTE_REPLIED;
+          }
+
+          // call route handler and cache its reply (200 OK replies only)
+          unsigned int headerFieldsBefore = wsp->httpResponseHeaderFields.length (); // Connection header field doesn't belong to the reply
+          httpResponseContent = reply (httpRequest, wsp);
+          if (slot < 0) return httpResponseContent != "" ? ROUTE_REPLIED : NOT_ROUTED;
+          if (httpResponseContent != "" && wsp->httpResponseStatus == "200 OK") {
+            size_t headerFieldsLength = wsp->httpResponseHeaderFields.length () - headerFieldsBefore;
+            if ((c = (__cachedResponse__ *) malloc (sizeof (__cachedResponse__) + keyLength + 1 + headerFieldsLength + 1 + httpResponseContent.length () + 1))) {
+              c->references = 1; // the cache's reference
+              c->keyLength = keyLength;
+              c->headerFieldsLength = headerFieldsLength;
+              memcpy (c->key (), key, keyLength); c->key () [keyLength] = 0;
+              memcpy (c->headerFields (), wsp->httpResponseHeaderFields.c_str () + headerFieldsBefore, headerFieldsLength + 1);
+              memcpy (c->content (), httpResponseContent.c_str (), httpResponseContent.length () + 1);
+              c->renderedMillis = millis ();
+            }
+          }
+          portENTER_CRITICAL (&__csResponseCache__);
+            __responseCacheSlot__ [slot].rendering = false;
+            __responseCacheSlot__ [slot].response = c; // NULL leaves the slot empty, the next request will call route handler again
+            if (!c) __responseCacheSlot__ [slot].hash = 0;
+          portEXIT_CRITICAL (&__csResponseCache__);
+          if (__responseCacheRendered__) xEventGroupSetBits (__responseCacheRendered__, 1 << slot); // wake up the threads waiting for this reply
+          return httpResponseContent != "" ? ROUTE_REPLIED : NOT_ROUTED;
+        }
+
+        String __responseCacheStatistics__ () {
+          portENTER_CRITICAL (&__csResponseCache__);
+            unsigned long hits = __responseCacheHits__;
+            unsigned long misses = __responseCacheMisses__;
+          portEXIT_CRITICAL (&__csResponseCache__);
+          return ",\"responseCache\":{\"hits\":" + String (hits) + ",\"misses\":" + String (misses) + "}"; // String allocates heap, so it is built outside of the critical section
+        }
+
+      #endif
+
+      // web sessions: open addressing hash table with linear probing, tokens are random so their first 8 hex digits are already a good hash
+      struct __session__ {
+        char token [33];                                    // 32 hex digits, "" if the slot is empty
+        char userName [USER_PASSWORD_MAX_LENGTH + 1];
+        unsigned long lastActiveMillis;                     // for sliding expiry
+      };
+      portMUX_TYPE __csSessions__ = portMUX_INITIALIZER_UNLOCKED;
+      __session__ *__sessions__ = NULL;                     // __HTTP_SESSION_HASH_SIZE__ slots, allocated with the first session
+      int __sessionCount__ = 0;
+
+      static int __sessionHash__ (const char *token) { // token has already been checked to consist of hex digits
+        unsigned int h = 0;
+        for (int i = 0; i < 8; i++) h = (h << 4) | (token [i] <= '9' ? token [i] - '0' : (token [i] | 0x20) - 'a' + 10);
+        return h & (__HTTP_SESSION_HASH_SIZE__ - 1);
+      }
+
+      int __findSession__ (const char *token, int length) { // returns the slot of the session or -1, call it inside __csSessions__ critical section
+        if (length != 32) return -1;
+        for (int i = 0; i < 32; i++) if (!isxdigit (token [i])) return -1;
+        for (int i = __sessionHash__ (token); *__sessions__ [i].token; i = (i + 1) & (__HTTP_SESSION_HASH_SIZE__ - 1)) {
+          unsigned char difference = 0;
+          for (int j = 0; j < 32; j++) difference |= __sessions__ [i].token [j] ^ token [j]; // compare in constant time so the response time doesn't reveal how much of the token was guessed right
+          if (!difference) return i;
+        }
+        return -1;
+      }
+
+      bool __removeSession__ (int i) { // call it inside __csSessions__ critical section, returns true if another session got shifted into slot i
+        // backward shift deletion: the sessions that follow in the same probe sequence are moved back so lookups never stop at a hole, no tombstones are needed
+        bool shifted = false;
+        int hole = i;
+        for (int j = (i + 1) & (__HTTP_SESSION_HASH_SIZE__ - 1); *__sessions__ [j].token; j = (j + 1) & (__HTTP_SESSION_HASH_SIZE__ - 1)) {
+          int home = __sessionHash__ (__sessions__ [j].token);
+          if (((j - home) & (__HTTP_SESSION_HASH_SIZE__ - 1)) >= ((j - hole) & (__HTTP_SESSION_HASH_SIZE__ - 1))) { // the session at j may be moved back into the hole without being placed before its home slot
+            __sessions__ [hole] = __sessions__ [j];
+            if (hole == i) shifted = true;
+            hole = j;
+          }
+        }
+        *__sessions__ [hole].token = 0;
+        __sessionCount__ --;
+        return shifted;
+      }
+
+      String __sessionUserName__ (const char *token, int length) {
+        if (!__sessions__) return "";
+        char userName [USER_PASSWORD_MAX_LENGTH + 1] = "";
+        unsigned long now = millis ();
+        portENTER_CRITICAL (&__csSessions__);
+          int i = __findSession__ (token, length);
+          if (i >= 0) {
+            if (now - __sessions__ [i].lastActiveMillis > HTTP_SERVER_SESSION_TIMEOUT * 1000UL) {
+              __removeSession__ (i); // expired
+            } else {
+              __sessions__ [i].lastActiveMillis = now; // sliding expiry
+              strcpy (userName, __sessions__ [i].userName);
+            }
+          }
+        portEXIT_CRITICAL (&__csSessions__);
+        return String (userName);
+      }
+
+      // statistics
+      portMUX_TYPE __csStatistics__ = portMUX_INITIALIZER_UNLOCKED;
+      unsigned long __connectionCount__ = 0;
+      unsigned long __requestCount__ = 0;
+      unsigned long __reusedConnectionRequestCount__ = 0;
+      unsigned long __bytesSent__ = 0;
+      unsigned long __bytesReceived__ = 0;
+      unsigned long __latencyHistogram__ [HTTP_SERVER_LATENCY_HISTOGRAM_SIZE] = {}; // element i counts requests that took between 2^i and 2^(i+1) microseconds to handle
+      unsigned long __statisticsStartMillis__ = millis ();
+
+      void __countConnection__ () {
+        portENTER_CRITICAL (&__csStatistics__);
+          __connectionCount__ ++;
+        portEXIT_CRITICAL (&__csStatistics__);
+      }
+
+      void __countRequest__ (unsigned long latencyMicros, unsigned long bytesReceived, unsigned long bytesSent, bool reusedConnection) {
+        int i = 0;
+        while (latencyMicros >>= 1) i ++; // i = log2 (latencyMicros)
+        if (i >= HTTP_SERVER_LATENCY_HISTOGRAM_SIZE) i = HTTP_SERVER_LATENCY_HISTOGRAM_SIZE - 1;
+        portENTER_CRITICAL (&__csStatistics__);
+          __requestCount__ ++;
+          if (reusedConnection) __reusedConnectionRequestCount__ ++;
+          __bytesReceived__ += bytesReceived;
+          __bytesSent__ += bytesSent;
+          __latencyHistogram__ [i] ++;
+        portEXIT_CRITICAL (&__csStatistics__);
+      }
+
+      static unsigned long __latencyPercentile__ (unsigned long *latencyHistogram, unsigned long requests, int perMille) { // estimates latency percentile with the upper limit of histogram element it falls into (so it is accurate to a factor of 2)
+        if (!requests) return 0;
+        unsigned long rank = (requests * perMille + 999) / 1000; // = ceil (requests * perMille / 1000)
+        unsigned long counted = 0;
+        for (int i = 0; i < HTTP_SERVER_LATENCY_HISTOGRAM_SIZE; i++)
+          if ((counted += latencyHistogram [i]) >= rank) return 2UL << i;
+        return 2UL << (HTTP_SERVER_LATENCY_HISTOGRAM_SIZE - 1);
+      }
+
+      static unsigned int __fileNameHash__ (const char *fileName) { // FNV-1a, case insensitive since FAT file names are
+        unsigned int h = 2166136261;
+        while (*fileName) h = (h ^ (uint8_t) tolower (*fileName ++)) * 16777619;
+        return h;
+      }
+
+      // file write counters: ETag can't be made of the time of last write if the clock wasn't set when the file was written, the number of writes is used instead (see __validators__)
+      portMUX_TYPE __csFileWrites__ = portMUX_INITIALIZER_UNLOCKED;
+      unsigned int __fileWrites__ [__HTTP_FILE_WRITE_COUNTERS__] = {}; // incremented by __fileChanged__, indexed by the hash of file name
+      uint32_t __fileWritesEpoch__ = esp_random ();         // counters start from 0 with each httpServer instance (and after each restart), so ETag contains this as well
+
+      #ifdef __FILE_SYSTEM__
+        static void __fileChanged__ (const char *fileName, void *ths) { // file change listener: counts writes of changed file (or all files in changed directory) and drops them from the cache
+          httpServer *srv = (httpServer *) ths;
+          size_t l = strlen (fileName); if (l && fileName [l - 1] == '/') l --;
+          bool directory = l < strlen (fileName);
+          if (!directory) { File d = FFat.open (fileName, FILE_READ); directory = d && d.isDirectory (); if (d) d.close (); } // renamed directory brings the files in it to new paths
+          unsigned int counter = __fileNameHash__ (fileName) & (__HTTP_FILE_WRITE_COUNTERS__ - 1);
+          portENTER_CRITICAL (&srv->__csFileWrites__);
+            if (directory) for (int i = 0; i < __HTTP_FILE_WRITE_COUNTERS__; i++) srv->__fileWrites__ [i] ++; else srv->__fileWrites__ [counter] ++;
+          portEXIT_CRITICAL (&srv->__csFileWrites__);
+          #if HTTP_SERVER_FILE_CACHE_SIZE > 0
+            bool gzip = l > 3 && !strncasecmp (fileName + l - 3, ".gz", 3); // writing or deleting fileName.gz changes whether fileName has gzip encoded variant (see gzipVariant)
+            __cachedFile__ *dropped = NULL;
+            portENTER_CRITICAL (&srv->__csFileCache__);
+              srv->__fileCacheChanges__ ++;
+              for (__cachedFile__ *c = srv->__newestCachedFile__; c; ) {
+                __cachedFile__ *older = c->older;
+                if (!strncasecmp (c->fileName (), fileName, l) && (c->fileName () [l] == 0 || c->fileName () [l] == '/')) srv->__unlinkCachedFile__ (c, &dropped);
+                else if (gzip && !strncasecmp (c->fileName (), fileName, l - 3) && c->fileName () [l - 3] == 0) srv->__unlinkCachedFile__ (c, &dropped);
+                c = older;
+              }
+            portEXIT_CRITICAL (&srv->__csFileCache__);
+            __freeCachedFiles__ (dropped);
+          #endif
+        }
+      #endif
+
+      #if defined (__FILE_SYSTEM__) && HTTP_SERVER_FILE_CACHE_SIZE > 0
+
+        // file cache: recently served files are kept in RAM, the least recently used are dropped when the cache gets full or when they are changed
+        struct __cachedFile__ {                               // file name and content follow this header in the same block of heap
+          __cachedFile__ *newer;                              // LRU list
+          __cachedFile__ *older;
+          int references;                                     // the cache itself holds one reference while the file is in the list, each request that is being served from it holds another one
+          unsigned int hash;                                  // of file name
+          size_t size;                                        // of content
+          time_t lastWrite;
+          bool gzipVariant;                                   // fileName.gz exists as well, so the replies need Vary:Accept-Encoding even when they are not gzip encoded
+          char *fileName () { return (char *) (this + 1); }
+          char *content () { return fileName () + strlen (fileName ()) + 1; }
+        };
+        portMUX_TYPE __csFileCache__ = portMUX_INITIALIZER_UNLOCKED;
+        __cachedFile__ *__newestCachedFile__ = NULL;
+        __cachedFile__ *__oldestCachedFile__ = NULL;
+        size_t __fileCacheBytes__ = 0;                        // the sum of sizes of cached files
+        unsigned int __fileCacheFiles__ = 0;
+        unsigned long __fileCacheChanges__ = 0;               // incremented each time files get dropped because they changed, so that a file that was being read at that time doesn't get cached
+        unsigned long __fileCacheHits__ = 0;
+        unsigned long __fileCacheMisses__ = 0;
+        unsigned long __fileCacheBytesServed__ = 0;
+
+        void __unlinkCachedFile__ (__cachedFile__ *c, __cachedFile__ **dropped) { // removes file from LRU list and adds it to the list of files to be freed (outside of critical section) if nobody is using it, call only inside critical section
+          if (c->newer) c->newer->older = c->older; else __newestCachedFile__ = c->older;
+          if (c->older) c->older->newer = c->newer; else __oldestCachedFile__ = c->newer;
+          __fileCacheBytes__ -= c->size;
+          __fileCacheFiles__ --;
+          if (!-- c->references) { c->older = *dropped; *dropped = c; }
+        }
+
+        static void __freeCachedFiles__ (__cachedFile__ *dropped) {
+          while (dropped) { __cachedFile__ *c = dropped; dropped = dropped->older; free (c); }
+        }
+
+        __cachedFile__ *__getCachedFile__ (const char *fileName, unsigned long *changes, bool countMiss = true) { // returns cached file (call __releaseCachedFile__ when finished with it) or NULL
+          unsigned int hash = __fileNameHash__ (fileName);
+          portENTER_CRITICAL (&__csFileCache__);
+            *changes = __fileCacheChanges__;
+            __cachedFile__ *c;
+            for (c = __newestCachedFile__; c; c = c->older) if (c->hash == hash && !strcasecmp (c->fileName (), fileName)) break;
+            if (c) {
+              if (c != __newestCachedFile__) { // move it to the front of LRU list
+                c->newer->older = c->older;
+                if (c->older) c->older->newer = c->newer; else __oldestCachedFile__ = c->newer;
+                c->newer = NULL;
+                c->older = __newestCachedFile__;
+                __newestCachedFile__->newer = c;
+                __newestCachedFile__ = c;
+              }
+              c->references ++;
+              __fileCacheHits__ ++;
+            } else if (countMiss) {
+              __fileCacheMisses__ ++;
+            }
+          portEXIT_CRITICAL (&__csFileCache__);
+          return c;
+        }
+
+        void __releaseCachedFile__ (__cachedFile__ *c) {
+          portENTER_CRITICAL (&__csFileCache__);
+            bool unused = !-- c->references;
+          portEXIT_CRITICAL (&__csFileCache__);
+          if (unused) free (c); // it has already been dropped from the cache
+        }
+
+        __cachedFile__ *__cacheFile__ (const char *fileName, File& f, unsigned long changes, bool gzipVariant) { // reads file into cache and returns it like __getCachedFile__ or NULL if it can't be cached
+          size_t size = f.size ();
+          size_t fileNameLength = strlen (fileName);
+          __cachedFile__ *c = (__cachedFile__ *) malloc (sizeof (__cachedFile__) + fileNameLength + 1 + size);
+          if (!c) return NULL;
+          memcpy (c->fileName (), fileName, fileNameLength + 1);
+          if (f.read ((uint8_t *) c->content (), size) != size) { free (c); f.seek (0); return NULL; }
+          c->size = size;
+          c->lastWrite = f.getLastWrite ();
+          c->gzipVariant = gzipVariant;
+          c->hash = __fileNameHash__ (fileName);
+          c->references = 1; // for the caller
+          c->newer = NULL;
+          __cachedFile__ *dropped = NULL;
+          portENTER_CRITICAL (&__csFileCache__);
+            if (changes == __fileCacheChanges__) { // nothing has changed while the file was being read
+              for (__cachedFile__ *d = __newestCachedFile__; d; d = d->older) if (d->hash == c->hash && !strcasecmp (d->fileName (), fileName)) { __unlinkCachedFile__ (d, &dropped); break; } // another thread has been faster
+              while (__oldestCachedFile__ && __fileCacheBytes__ + size > HTTP_SERVER_FILE_CACHE_SIZE) __unlinkCachedFile__ (__oldestCachedFile__, &dropped); // make room
+              c->references ++; // for the cache
+              c->older = __newestCachedFile__;
+              if (__newestCachedFile__) __newestCachedFile__->newer = c; else __oldestCachedFile__ = c;
+              __newestCachedFile__ = c;
+              __fileCacheBytes__ += size;
+              __fileCacheFiles__ ++;
+            }
+          portEXIT_CRITICAL (&__csFileCache__);
+          __freeCachedFiles__ (dropped);
+          return c;
+        }
+
+        String __sendCachedFile__ (__cachedFile__ *c, httpServer::wwwSessionParameters *wsp, size_t from, size_t length) {
+          String httpHeader = "HTTP/1.1 " + wsp->httpResponseStatus + "\r\n" + wsp->httpResponseHeaderFields + "Content-Length:" + String ((unsigned long) length) + "\r\n\r\n";
+          struct iovec httpResponse [2] = {{(char *) httpHeader.c_str (), httpHeader.length ()}, {c->content () + from, length}};
+          if (wsp->getHttpRequestMethod ().equals ("HEAD")) { // HEAD reply only has the header
+            wsp->connection->sendData (httpResponse, 1);
+          } else {
+            wsp->connection->sendData (httpResponse, 2);
+            portENTER_CRITICAL (&__csFileCache__);
+              __fileCacheBytesServed__ += length;
+            portEXIT_CRITICAL (&__csFileCache__);
+          }
+          __releaseCachedFile__ (c);
+          return ""; // already sent
+        }
+
+        String __fileCacheStatistics__ () {
+          portENTER_CRITICAL (&__csFileCache__);
+            String s = ",\"fileCache\":{\"hits\":" + String (__fileCacheHits__) + 
+                       ",\"misses\":" + String (__fileCacheMisses__) + 
+                       ",\"bytesServed\":" + String (__fileCacheBytesServed__) + 
+                       ",\"cachedFiles\":" + String (__fileCacheFiles__) + 
+                       ",\"cachedBytes\":" + String ((unsigned long) __fileCacheBytes__) + 
+                       ",\"size\":" + String ((unsigned long) HTTP_SERVER_FILE_CACHE_SIZE) + "}";
+          portEXIT_CRITICAL (&__csFileCache__);
+          return s;
+        }
+
+      #endif
+
+      void __rejectConnection__ (int connectionSocket) { // all worker threads are busy, tell the client to come back later
+        webDmesg ("[httpServer] all worker threads are busy, rejecting connection.");
+        const char *reply = "HTTP/1.1 503 Service Unavailable\r\nRetry-After:1\r\nContent-Length:0\r\nConnection:close\r\n\r\n";
+        send (connectionSocket, reply, strlen (reply), 0); // non-blocking socket, if the reply doesn't fit into TCP buffer at once the client will just see connection being closed
+      }
+
+      void __rejectRateLimitedConnection__ (int connectionSocket) { // the client has exceeded its rate limit (see setRateLimit)
+        String reply = __tooManyRequestsReply__ ();
+        send (connectionSocket, reply.c_str (), reply.length (), 0); // non-blocking socket, a short reply fits into empty TCP buffer
+      }
+
+      String __tooManyRequestsReply__ () { // tells the client when it will have a token again
+        portENTER_CRITICAL (&__csRateLimit__);
+          float tokensPerSecond = __rateLimitTokensPerSecond__;
+        portEXIT_CRITICAL (&__csRateLimit__);
+        int retryAfter = tokensPerSecond > 0 && tokensPerSecond < 1 ? (int) (1 / tokensPerSecond + 0.999) : 1;
+        return "HTTP/1.1 429 Too many requests\r\nRetry-After:" + String (retryAfter) + "\r\nContent-Length:0\r\nConnection:close\r\n\r\n";
+      }
+
+      struct __httpConnectionState__ {                 // what connection handler needs to remember between incoming blocks of data
+        char buffer [HTTP_SERVER_REQUEST_BUFFER_SIZE]; // fixed buffer for incoming HTTP request(s) - the whole HTTP request header must fit into it
+        int length = 0;                                // number of bytes in buffer
+        httpRequestParser parser;                      // the state of parsing HTTP request at the beginning of buffer
+        bool discardingBody = false;                   // the request has already been handled, its body (that didn't fit into buffer) is being discarded
+        unsigned int requests = 0;                     // requests handled on this connection so far
+      };
+
       static void __webConnectionHandler__ (TcpConnection *connection, void *thisWebServer) {  // connectionHandler callback function
         httpServer *ths = (httpServer *) thisWebServer; // this is how you pass "this" pointer to static memeber function
+        ths->__countConnection__ ();
 
-        char buffer [2048 + 1]; *buffer = 0;
-        String incomingRequests = "";
+        __httpConnectionState__ state; // on connection handler's stack
         int received;
-        while ((received = connection->recvData (buffer, sizeof (buffer) - 1))) { // read block of incoming HTTP request(s)
+        while ((received = connection->recvData (state.buffer + state.length, sizeof (state.buffer) - state.length))) { // read block of incoming HTTP request(s)
           // Serial.printf ("   DEBUG {socket %i} received %i bytes\n", connection->getSocket (), received );
-          buffer [received] = 0;
-          // append it to already existing part of HTTP request
-          incomingRequests += String (buffer);
-          // check if the end of HTTP request has already arrived
-          int i = incomingRequests.indexOf ("\r\n\r\n");
-          if (i >= 0) {
-            // Serial.printf ("   DEBUG {socket %i} received HTTP request\n", connection->getSocket () );
-            String httpRequest = incomingRequests.substring (0, i + 4);
-            wwwSessionParameters wsp (&httpRequest, &ths->__webServerHomeDirectory__, connection);
-
-            // we have got HTTP request
-            // 1st check if it is ws request - then cal WS handler
-            // 2nd check if exterrnal HTTP handler (provided by calling program) is going to handle it
-            // 3rd handle HTTP request internaly:
-            //    - if it is a HTML file name then reply with file content
-            //    - reply with error 404 if it is not
-            
-            if (stristr (buffer, (char *) "CONNECTION: UPGRADE")) {
-              connection->setTimeOut (300000); // set time-out to 5 minutes for WebSockets (by default if is 1.5 s for HTTP requests)
-              WebSocket *webSocket = new WebSocket (connection, httpRequest); 
-              if (webSocket && webSocket->isOpened ()) { // check success
-                if (ths->__externalWsRequestHandler__) ths->__externalWsRequestHandler__ (httpRequest, webSocket);
-                delete (webSocket);
-              } else {
-                webDmesg ("[httpServer] can't open WebSocket.");
+          state.length += received;
+          if (ths->__processIncomingRequests__ (state, connection) != TcpServer::KEEP_CONNECTION) break; // close this connection
+        } // while
+      }
+
+      // Reactor mode is meant for many mostly idle connections with small replies (polling routes, small or cached files): an idle connection
+      // costs only its TcpConnection and context instead of a thread with its own stack. But requests are handled in the reactor thread 
+      // itself, so whatever blocks there holds up all the other connections - sending a large file (or any reply) to a slow client, reading
+      // a request body that hasn't arrived yet (PUT, multipart/form-data uploads) and streamed replies can take up to the connection time-out.
+      // Only WebSockets and event streams, which block for their whole lifetime, are handed over to threads of their own. Use a worker pool
+      // instead if the server sends large files or accepts uploads.
+      static CONNECTION_EVENT_RESULT_TYPE __webConnectionEventHandler__ (TcpConnection *connection, void *thisWebServer) {  // connectionEventCallback function (reactor mode)
+        httpServer *ths = (httpServer *) thisWebServer; // this is how you pass "this" pointer to static memeber function
+
+        // in reactor mode connection state lives in connection context instead of on connection handler's stack
+        __httpConnectionState__ *state = (__httpConnectionState__ *) connection->getConnectionContext ();
+        if (connection->isClosed ()) { // connection has been closed, free its context
+          if (state) delete (state);
+          connection->setConnectionContext (NULL);
+          return TcpServer::CLOSE_CONNECTION;
+        }
+        if (!state) {
+          if (!(state = new __httpConnectionState__ ())) return TcpServer::CLOSE_CONNECTION;
+          connection->setConnectionContext (state);
+          ths->__countConnection__ (); // this is the first event of a new connection
+        }
+
+        int received = connection->recvData (state->buffer + state->length, sizeof (state->buffer) - state->length); // select () has already reported that data is waiting so this won't block
+        if (!received) return TcpServer::CLOSE_CONNECTION;
+        state->length += received;
+        CONNECTION_EVENT_RESULT_TYPE result = ths->__processIncomingRequests__ (*state, connection);
+        if (result == TcpServer::RELEASE_CONNECTION) { // WebSocket (or event stream) thread took the connection over, context is not needed any more
+          delete (state);
+          connection->setConnectionContext (NULL);
+        }
+        return result;
+      }
+
+      // handles all complete HTTP requests that have arrived so far and removes them from the buffer, returns what should happen with the connection afterwards
+      CONNECTION_EVENT_RESULT_TYPE __processIncomingRequests__ (__httpConnectionState__& state, TcpConnection *connection) {
+        while (true) {
+
+          if (state.discardingBody) { // skip the rest of the body of the request that has already been handled
+            char *bodyPart;
+            int bodyPartLength;
+            int consumed;
+            while (!state.parser.bodyComplete () && (consumed = state.parser.decodeBody (state.buffer, state.length, &bodyPart, &bodyPartLength))) __consumeBuffer__ (state, consumed);
+            if (state.parser.bodyError ()) return __replyWithError__ (connection, "400 Bad request");
+            if (!state.parser.bodyComplete ()) {
+              if (state.length == sizeof (state.buffer)) return __replyWithError__ (connection, "400 Bad request"); // chunk size line doesn't fit into buffer
+              return TcpServer::KEEP_CONNECTION; // wait for the rest of the body
+            }
+            state.discardingBody = false;
+            state.parser.reset ();
+          }
+
+          switch (state.parser.parse (state.buffer, state.length)) { // only the part that arrived since the last call is parsed
+            case httpRequestParser::INCOMPLETE:   if (state.length == sizeof (state.buffer)) return __replyWithError__ (connection, "431 Request header fields too large");
+                                                  return TcpServer::KEEP_CONNECTION; // wait for the rest of HTTP request header
+            case httpRequestParser::BAD_REQUEST:  return __replyWithError__ (connection, "400 Bad request");
+            default:                              break; // COMPLETE
+          }
+          // Serial.printf ("   DEBUG {socket %i} received HTTP request\n", connection->getSocket () );
+
+          int requestLength = state.parser.headerLength;
+          bool expectContinue = state.parser.headerFieldIndex (state.buffer, "Expect") >= 0; // the client waits for 100 Continue before sending the body, see readHttpRequestBody
+          if (!state.parser.chunked && state.parser.contentLength > 0 && requestLength + state.parser.contentLength <= (long) sizeof (state.buffer) && !expectContinue) { // the body fits into buffer, pass it to request handler together with the header
+            if (state.length < requestLength + state.parser.contentLength) return TcpServer::KEEP_CONNECTION; // wait for the rest of the body
+            requestLength += state.parser.contentLength;
+            state.parser.skipBody ();
+          }
+          if (state.requests && !__admitClient__ (inet_addr (connection->getOtherSideIP ()))) { // the first request has been admitted together with the connection, the following ones on persistent connection need their own tokens
+            connection->sendData (__tooManyRequestsReply__ ());
+            return TcpServer::CLOSE_CONNECTION;
+          }
+          String httpRequest;
+          httpRequest.concat (state.buffer, requestLength); // the only copy of HTTP request, calling program expects it in a String
+          __consumeBuffer__ (state, requestLength); // what remains in the buffer is the body (that didn't fit into httpRequest) or the next request
+          unsigned long requestStartMicros = micros ();
+          unsigned long bytesSentBefore = connection->getBytesSent ();
+          wwwSessionParameters wsp (&httpRequest, &__webServerHomeDirectory__, connection, this, &state.parser);
+          wsp.__connectionState__ = &state;
+
+          // we have got HTTP request
+          // 1st check if it is ws request - then cal WS handler
+          // 2nd check if exterrnal HTTP handler (provided by calling program) is going to handle it
+          // 3rd handle HTTP request internaly:
+          //    - if it is a HTML file name then reply with file content
+          //    - reply with error 404 if it is not
+          
+          httpField connectionFieldValue = wsp.findHttpRequestHeaderField ("Connection");
+          if (connectionFieldValue.containsIgnoreCase ("upgrade")) {
+            connection->setTimeOut (300000); // set time-out to 5 minutes for WebSockets (by default if is HTTP_SERVER_IDLE_TIMEOUT for HTTP requests)
+            if (__reactorMode__ ()) { // WebSocket would block reactor thread so it must run in a thread of its own
+              __webSocketTaskParameters__ *p = new __webSocketTaskParameters__ {this, connection, httpRequest};
+              if (p && pdPASS == xTaskCreate (__webSocketTask__, "WebSocket", __connectionStackSize__, p, tskNORMAL_PRIORITY, NULL)) return TcpServer::RELEASE_CONNECTION;
+              if (p) delete (p);
+              webDmesg ("[httpServer] can't start WebSocket thread.");
+              return TcpServer::CLOSE_CONNECTION;
+            }
+            __runWebSocket__ (connection, httpRequest);
+            return TcpServer::CLOSE_CONNECTION; // close this connection
+          }
+
+          // HTTP/1.1 connections are persistent by default, HTTP/1.0 connections only if the client asks for it
+          bool http11 = wsp.getHttpRequestVersion ().equals ("HTTP/1.1");
+          bool keepAlive = http11 ? !connectionFieldValue.containsIgnoreCase ("close") : connectionFieldValue.containsIgnoreCase ("keep-alive");
+          portENTER_CRITICAL (&csTcpConnectionInternalStructure);
+            unsigned int maxRequestsPerConnection = __maxRequestsPerConnection__; // setKeepAlive may change it at any time
+          portEXIT_CRITICAL (&csTcpConnectionInternalStructure);
+          if (++ state.requests == maxRequestsPerConnection) keepAlive = false;
+          if (http11 && !keepAlive) wsp.httpResponseHeaderFields = "Connection:close\r\n"; // let the client know it shouldn't send more requests on this connection
+          if (!http11 && keepAlive) wsp.httpResponseHeaderFields = "Connection:keep-alive\r\n"; // HTTP/1.0 client needs confirmation
+
+          String httpResponseContent;
+          __routeResultType__ routeResult = NOT_ROUTED;
+          if ((__externalHttpRequestHandler__ && (httpResponseContent = __externalHttpRequestHandler__ (httpRequest, &wsp)) != "") || (routeResult = __dispatchRoute__ (httpRequest, &wsp, httpResponseContent)) == ROUTE_REPLIED) {
+            // debug: Serial.println ("HTTP/1.1 " + wsp.httpResponseStatus + "\r\n" + wsp.getHttpResponseHeaderFields () + "Content-Length:" + String (httpResponseContent.length ()) + "\r\n\r\n" + httpResponseContent);
+            String httpResponseHeader = "HTTP/1.1 " + wsp.httpResponseStatus + "\r\n" + wsp.httpResponseHeaderFields + "Content-Length:" + String (httpResponseContent.length ()) + "\r\n\r\n";
+            struct iovec httpResponse [2] = {{(char *) httpResponseHeader.c_str (), httpResponseHeader.length ()}, {(char *) httpResponseContent.c_str (), httpResponseContent.length ()}}; // send header and content without copying them together
+            connection->sendData (httpResponse, 2);
+          } else if (routeResult == NOT_ROUTED) {
+            int eventStream = __findEventStream__ (&wsp);
+            if (eventStream >= 0) { // Server-Sent Events: the connection now belongs to the event stream until the subscriber disconnects
+              __countRequest__ (micros () - requestStartMicros, requestLength, 0, state.requests > 1);
+              #ifdef __FILE_SYSTEM__
+                __logRequest__ (&wsp, 200, 0, micros () - requestStartMicros);
+              #endif
+              unsigned long lastEventId = strtoul (wsp.findHttpRequestHeaderField ("Last-Event-ID").toString ().c_str (), NULL, 10);
+              if (__reactorMode__ ()) { // event stream would block reactor thread so it must run in a thread of its own
+                __eventStreamTaskParameters__ *p = new __eventStreamTaskParameters__ {this, connection, eventStream, lastEventId};
+                if (p && pdPASS == xTaskCreate (__eventStreamTask__, "EventStream", __connectionStackSize__, p, tskNORMAL_PRIORITY, NULL)) return TcpServer::RELEASE_CONNECTION;
+                if (p) delete (p);
+                webDmesg ("[httpServer] can't start event stream thread.");
+                return TcpServer::CLOSE_CONNECTION;
               }
-              return; // close this connection
+              __runEventStream__ (connection, eventStream, lastEventId);
+              return TcpServer::CLOSE_CONNECTION;
             }
+            String httpReply = __internalHttpRequestHandler__ (httpRequest, &wsp);
+            if (httpReply.startsWith ("HTTP/")) wsp.httpResponseStatus = httpReply.substring (9, httpReply.indexOf ('\r')); // internal replies come with their own status line, the files that have already been sent have their status in httpResponseStatus
+            connection->sendData (httpReply); // send reply to browser
+          } // else streaming route handler has already sent the reply
+          unsigned long requestMicros = micros () - requestStartMicros;
+          __countRequest__ (requestMicros, requestLength, connection->getBytesSent () - bytesSentBefore, state.requests > 1);
+          #ifdef __FILE_SYSTEM__
+            __logRequest__ (&wsp, wsp.httpResponseStatus.toInt (), connection->getBytesSent () - bytesSentBefore, requestMicros);
+          #endif
 
-            String httpResponseContent;
-            if (ths->__externalHttpRequestHandler__ && (httpResponseContent = ths->__externalHttpRequestHandler__ (httpRequest, &wsp)) != "") {
-              // debug: Serial.println ("HTTP/1.1 " + wsp.httpResponseStatus + "\r\n" + wsp.getHttpResponseHeaderFields () + "Content-Length:" + String (httpResponseContent.length ()) + "\r\n\r\n" + httpResponseContent);
-              connection->sendData ("HTTP/1.1 " + wsp.httpResponseStatus + "\r\n" + wsp.httpResponseHeaderFields + "Content-Length:" + String (httpResponseContent.length ()) + "\r\n\r\n" + httpResponseContent);
-            } else {
-              connection->sendData (ths->__internalHttpRequestHandler__ (httpRequest, &wsp)); // send reply to browser
+          // keep connection alive for the following requests (that may already be waiting in the buffer) if possible
+          if (!keepAlive || routeResult == ROUTE_STREAMED_AND_CLOSE || state.parser.bodyError ()) return TcpServer::CLOSE_CONNECTION; // close this connection
+          if (expectContinue && !wsp.__continueSent__ && !state.parser.bodyComplete ()) return TcpServer::CLOSE_CONNECTION; // the client won't send the body that request handler didn't want
+          // read another request on this connection
+          if (state.parser.bodyComplete ()) state.parser.reset ();
+          else                              state.discardingBody = true; // the body didn't fit into buffer and request handler hasn't read it (or hasn't read all of it)
+        }
+      }
+
+      void __consumeBuffer__ (__httpConnectionState__& state, int bytes) { // removes bytes from the beginning of the buffer
+        memmove (state.buffer, state.buffer + bytes, state.length - bytes);
+        state.length -= bytes;
+      }
+
+      int __readHttpRequestBody__ (__httpConnectionState__& state, wwwSessionParameters *wsp, char *buffer, int bufferSize) { // see wwwSessionParameters::readHttpRequestBody
+        httpField body = wsp->getHttpRequestBody ();
+        if (wsp->__bodyBytesRead__ < body.length) { // the body has been received together with the header
+          int l = body.length - wsp->__bodyBytesRead__ < bufferSize ? body.length - wsp->__bodyBytesRead__ : bufferSize;
+          memcpy (buffer, body.value + wsp->__bodyBytesRead__, l);
+          wsp->__bodyBytesRead__ += l;
+          return l;
+        }
+        while (true) {
+          if (state.parser.bodyError ()) return -1;
+          if (state.parser.bodyComplete ()) return 0;
+          unsigned long dataRemaining = state.parser.bodyDataRemaining ();
+
+          if (state.length) { // decode what is already in the buffer
+            char *bodyPart;
+            int bodyPartLength;
+            int consumed = state.parser.decodeBody (state.buffer, dataRemaining && state.length > bufferSize ? bufferSize : state.length, &bodyPart, &bodyPartLength); // only a line (chunk size, ...) is expected if there are no data remaining
+            if (consumed) {
+              memcpy (buffer, bodyPart, bodyPartLength);
+              __consumeBuffer__ (state, consumed);
+              if (bodyPartLength) return bodyPartLength;
+              continue;
             }
+            if (state.parser.bodyError () || state.parser.bodyComplete ()) continue;
+            if (state.length == sizeof (state.buffer)) return -1; // chunk size line doesn't fit into buffer
+          }
 
-            // if the client wants to keep connection alive for the following requests then let it be so
-            if (stristr ((char *) httpRequest.c_str (), (char *) "CONNECTION: KEEP-ALIVE")) {
-              incomingRequests = incomingRequests.substring (i + 4); // read another request on this connection
-            } else {
-              break; // close this connection
+          if (!wsp->__continueSent__) { // the client may be waiting for permission before sending the body
+            wsp->__continueSent__ = true;
+            if (wsp->findHttpRequestHeaderField ("Expect").equalsIgnoreCase ("100-continue")) wsp->connection->sendData ((char *) "HTTP/1.1 100 Continue\r\n\r\n");
+          }
+
+          int received;
+          if (!state.length && dataRemaining) { // receive body data directly into the caller's buffer, without copying, but not beyond the current chunk
+            if (!(received = wsp->connection->recvData (buffer, dataRemaining < (unsigned long) bufferSize ? dataRemaining : bufferSize))) return -1;
+            char *bodyPart;
+            int bodyPartLength;
+            state.parser.decodeBody (buffer, received, &bodyPart, &bodyPartLength); // all received bytes are body data, this only updates parser's state
+            return received;
+          }
+          if (!(received = wsp->connection->recvData (state.buffer + state.length, sizeof (state.buffer) - state.length))) return -1;
+          state.length += received;
+        }
+      }
+
+      static int __findDelimiter__ (const char *data, int dataLength, const char *delimiter, int delimiterLength, const uint8_t *skip) { // Boyer-Moore-Horspool search, returns the position of delimiter in data or -1
+        for (int i = 0; i + delimiterLength <= dataLength; i += skip [(uint8_t) data [i + delimiterLength - 1]])
+          if (data [i + delimiterLength - 1] == delimiter [delimiterLength - 1] && !memcmp (data + i, delimiter, delimiterLength - 1)) return i;
+        return -1;
+      }
+
+      static String __headerParameter__ (const char *value, int length, const char *parameterName) { // returns the value of parameter, like name in: form-data; name="file"; filename="a.txt"
+        int l = strlen (parameterName);
+        for (int i = 0; i + l < length; i++)
+          if ((i == 0 || value [i - 1] == ';' || value [i - 1] == ' ') && !strncasecmp (value + i, parameterName, l) && value [i + l] == '=') {
+            const char *v = value + i + l + 1;
+            const char *e = value + length;
+            if (v < e && *v == '"') { v++; const char *q = (const char *) memchr (v, '"', e - v); if (q) e = q; }
+            else { const char *q = (const char *) memchr (v, ';', e - v); if (q) e = q; }
+            String s; s.concat (v, e - v);
+            return s;
+          }
+        return "";
+      }
+
+      bool __readMultipartHttpRequestBody__ (wwwSessionParameters *wsp, httpMultipartSink sink, void *param) { // see wwwSessionParameters::readMultipartHttpRequestBody
+        // get boundary from Content-Type: multipart/form-data; boundary=...
+        httpField contentType = wsp->findHttpRequestHeaderField ("Content-Type");
+        if (contentType.length < 10 || strncasecmp (contentType.value, "multipart/", 10)) return false;
+        String boundary = __headerParameter__ (contentType.value, contentType.length, "boundary");
+        if (boundary.length () < 1 || boundary.length () > 70) return false;
+        char delimiter [75]; // CRLF -- boundary
+        int delimiterLength = sprintf (delimiter, "\r\n--%s", boundary.c_str ());
+        uint8_t skip [256]; // Horspool's bad character table: how far the search can move when the character under the last delimiter position doesn't match
+        memset (skip, delimiterLength, sizeof (skip));
+        for (int i = 0; i < delimiterLength - 1; i++) skip [(uint8_t) delimiter [i]] = delimiterLength - 1 - i;
+
+        char *window = (char *) malloc (HTTP_SERVER_MULTIPART_BUFFER_SIZE); // sliding window over the body, it only has to keep what might be the beginning of a delimiter between reads
+        if (!window) { webDmesg ("[httpServer] not enough memory for multipart body."); return false; }
+        memcpy (window, "\r\n", 2); // the first delimiter is not preceded by CRLF, pretend it is
+        int length = 2;
+        enum { PREAMBLE, DELIMITER_END, PART_HEADER, PART_DATA } state = PREAMBLE;
+        httpMultipartPart part;
+        bool success = false;
+        bool failed = false;
+
+        while (!success && !failed) {
+          int consumed = 0;
+          while (!success && !failed) { // process the window until more data is needed
+            char *p = window + consumed;
+            int l = length - consumed;
+            if (state == PREAMBLE || state == PART_DATA) {
+              int i = __findDelimiter__ (p, l, delimiter, delimiterLength, skip);
+              int dataLength = i >= 0 ? i : l - delimiterLength + 1; // the end of the window may hold the beginning of a delimiter
+              if (dataLength > 0) {
+                if (state == PART_DATA) {
+                  if (!(failed = !sink (MULTIPART_PART_DATA, &part, p, dataLength, param))) part.length += dataLength;
+                }
+                consumed += dataLength;
+              }
+              if (i < 0 || failed) break;
+              if (state == PART_DATA && (failed = !sink (MULTIPART_PART_END, &part, NULL, 0, param))) { state = PREAMBLE; break; } // the part has ended, it is not a failed part any more
+              consumed += delimiterLength;
+              state = DELIMITER_END;
+            } else if (state == DELIMITER_END) { // -- after the last delimiter, CRLF otherwise
+              if (l < 2) break;
+              if (p [0] == '-' && p [1] == '-') success = true; // what follows is epilogue
+              else if (p [0] == '\r' && p [1] == '\n') { consumed += 2; part = httpMultipartPart (); state = PART_HEADER; }
+              else if (p [0] == '\n') { consumed += 1; part = httpMultipartPart (); state = PART_HEADER; } // tolerate LF line endings, like in part header
+              else failed = true;
+            } else { // PART_HEADER, line by line
+              char *eol = (char *) memchr (p, '\n', l);
+              if (!eol) break;
+              consumed += eol - p + 1;
+              int lineLength = eol - p; if (lineLength && p [lineLength - 1] == '\r') lineLength --;
+              if (!lineLength) { // empty line concludes part header
+                part.length = 0;
+                state = PART_DATA;
+                failed = !sink (MULTIPART_PART_BEGIN, &part, NULL, 0, param);
+              } else if (lineLength > 20 && !strncasecmp (p, "Content-Disposition:", 20)) {
+                part.name = __headerParameter__ (p + 20, lineLength - 20, "name");
+                part.fileName = __headerParameter__ (p + 20, lineLength - 20, "filename");
+              } else if (lineLength > 13 && !strncasecmp (p, "Content-Type:", 13)) {
+                int i = 13; while (i < lineLength && p [i] == ' ') i++;
+                part.contentType = ""; part.contentType.concat (p + i, lineLength - i);
+              }
             }
           }
-        } // while
+          if (success || failed) break;
+          // keep what hasn't been processed yet and read more
+          memmove (window, window + consumed, length - consumed);
+          length -= consumed;
+          if (length == HTTP_SERVER_MULTIPART_BUFFER_SIZE) { failed = true; break; } // part header line doesn't fit into the window
+          int received = wsp->readHttpRequestBody (window + length, HTTP_SERVER_MULTIPART_BUFFER_SIZE - length);
+          if (received <= 0) { failed = true; break; } // the body ended before the last delimiter
+          length += received;
+        }
+        if (failed && state == PART_DATA) sink (MULTIPART_PART_FAILED, &part, NULL, 0, param);
+        if (success) while (wsp->readHttpRequestBody (window, HTTP_SERVER_MULTIPART_BUFFER_SIZE) > 0); // read epilogue (usually just CRLF) so the body is complete
+        free (window);
+        return success;
+      }
+
+      CONNECTION_EVENT_RESULT_TYPE __replyWithError__ (TcpConnection *connection, String httpResponseStatus) { // the connection can't continue after errors in HTTP protocol
+        connection->sendData ("HTTP/1.1 " + httpResponseStatus + "\r\nContent-Length:" + String (httpResponseStatus.length () - 4) + "\r\nConnection:close\r\n\r\n" + httpResponseStatus.substring (4));
+        return TcpServer::CLOSE_CONNECTION;
+      }
+
+      // Server-Sent Events: the latest events are kept in a ring of reference counted blocks, subscribers follow it by event id
+      struct __event__ {                                    // event text follows this header in the same block of heap
+        int references;                                     // the queue holds one reference while the event is in it, each subscriber that is sending it holds another one
+        unsigned long id;                                   // events of all streams are numbered together
+        int stream;                                         // index of __eventStreamPath__
+        size_t length;
+        char *text () { return (char *) (this + 1); }
+      };
+      String __eventStreamPath__ [HTTP_SERVER_MAX_EVENT_STREAMS];
+      int __eventStreamCount__ = 0;                         // written under __csEvents__ after the path is in place, so read it under __csEvents__ too
+      struct __eventSubscriber__ {                          // lives on subscriber's stack while it is in __eventSubscriberList__
+        TaskHandle_t task;                                  // publishEvent notifies it when there is a new event for its stream
+        int stream;
+        __eventSubscriber__ *next;
+      };
+      __eventSubscriber__ *__eventSubscriberList__ = NULL;
+      bool __eventStreamsClosing__ = false;                 // ~httpServer tells the subscribers to leave
+      SemaphoreHandle_t __eventStreamMutex__ = xSemaphoreCreateMutex (); // guards __eventSubscriberList__ (publishEvent holds it while notifying) and serializes addEventStream calls
+      portMUX_TYPE __csEvents__ = portMUX_INITIALIZER_UNLOCKED;
+      __event__ *__eventQueue__ [HTTP_SERVER_EVENT_QUEUE_LENGTH] = {}; // event with id n is at n % HTTP_SERVER_EVENT_QUEUE_LENGTH
+      unsigned long __lastEventId__ = 0;
+      int __eventSubscribers__ [HTTP_SERVER_MAX_EVENT_STREAMS] = {}; // of each stream
+
+      void __releaseEvent__ (__event__ *e) {
+        portENTER_CRITICAL (&__csEvents__);
+          bool unused = !-- e->references;
+        portEXIT_CRITICAL (&__csEvents__);
+        if (unused) free (e); // it has already been dropped from the queue
+      }
+
+      int __findEventStream__ (wwwSessionParameters *wsp) { // returns the index of event stream HTTP request asks for or -1
+        portENTER_CRITICAL (&__csEvents__);
+          int count = __eventStreamCount__;
+        portEXIT_CRITICAL (&__csEvents__);
+        if (!count || !wsp->getHttpRequestMethod ().equals ("GET")) return -1;
+        httpField path = wsp->getHttpRequestPath ();
+        for (int i = 0; i < count; i++) if (path.equals (__eventStreamPath__ [i].c_str ())) return i;
+        return -1;
+      }
+
+      int __findEventStream__ (const char *path) { // returns the index of event stream path or -1
+        portENTER_CRITICAL (&__csEvents__);
+          int count = __eventStreamCount__;
+        portEXIT_CRITICAL (&__csEvents__);
+        for (int i = 0; i < count; i++) if (__eventStreamPath__ [i] == path) return i;
+        return -1;
+      }
+
+      void __runEventStream__ (TcpConnection *connection, int stream, unsigned long lastEventId) { // sends events to the subscriber until it disconnects
+        connection->setTimeOut (TcpConnection::INFINITE); // the subscriber never sends anything, it only waits for events
+        unsigned long nextEventId;
+        portENTER_CRITICAL (&__csEvents__);
+          __eventSubscribers__ [stream] ++;
+          nextEventId = lastEventId && lastEventId <= __lastEventId__ ? lastEventId + 1 : __lastEventId__ + 1; // reconnecting browser gets the events it has missed (if they are still in the queue)
+        portEXIT_CRITICAL (&__csEvents__);
+        __eventSubscriber__ subscriber = {xTaskGetCurrentTaskHandle (), stream, NULL};
+        xSemaphoreTake (__eventStreamMutex__, portMAX_DELAY);
+          subscriber.next = __eventSubscriberList__;
+          __eventSubscriberList__ = &subscriber;
+        xSemaphoreGive (__eventStreamMutex__);
+        bool connected = connection->sendData ((char *) "HTTP/1.1 200 OK\r\nContent-Type:text/event-stream\r\nCache-Control:no-cache\r\nConnection:close\r\n\r\n") > 0; // the reply ends when the connection closes
+        unsigned long lastSentMillis = millis ();
+        while (connected && !__instanceUnloading__ && !__eventStreamsClosing__) {
+          __event__ *e = NULL;
+          portENTER_CRITICAL (&__csEvents__);
+            if (__lastEventId__ - nextEventId + 1 > HTTP_SERVER_EVENT_QUEUE_LENGTH && nextEventId <= __lastEventId__) nextEventId = __lastEventId__ - HTTP_SERVER_EVENT_QUEUE_LENGTH + 1; // too slow subscriber skips the events that are not in the queue any more
+            if (nextEventId <= __lastEventId__ && (e = __eventQueue__ [nextEventId % HTTP_SERVER_EVENT_QUEUE_LENGTH])) e->references ++;
+            if (nextEventId <= __lastEventId__) nextEventId ++;
+          portEXIT_CRITICAL (&__csEvents__);
+          if (e) {
+            if (e->stream == stream) {
+              connected = connection->sendData (e->text (), e->length) == (int) e->length;
+              lastSentMillis = millis ();
+            }
+            __releaseEvent__ (e);
+            continue;
+          }
+          // nothing to send, check if the subscriber is still there
+          switch (connection->available ()) {
+            case TcpConnection::NOT_AVAILABLE:  break;
+            case TcpConnection::AVAILABLE:      { char buffer [64]; connected = connection->recvData (buffer, sizeof (buffer)) > 0; } break; // subscriber is not supposed to send anything, 0 means it has closed the connection
+            default:                            connected = false; break;
+          }
+          if (connected && millis () - lastSentMillis >= 15000) { // comment line keeps proxies from closing idle connection and finds out if the subscriber is gone
+            connected = connection->sendData ((char *) ":\n\n", 3) == 3;
+            lastSentMillis = millis ();
+          }
+          if (connected) ulTaskNotifyTake (pdTRUE, pdMS_TO_TICKS (1000)); // publishEvent wakes us up as soon as there is a new event, the time-out only limits how long it takes to notice that the subscriber has gone
+        }
+        xSemaphoreTake (__eventStreamMutex__, portMAX_DELAY);
+          for (__eventSubscriber__ **s = &__eventSubscriberList__; *s; s = &(*s)->next) if (*s == &subscriber) { *s = subscriber.next; break; }
+        xSemaphoreGive (__eventStreamMutex__);
+        portENTER_CRITICAL (&__csEvents__);
+          __eventSubscribers__ [stream] --;
+        portEXIT_CRITICAL (&__csEvents__);
       }
 
+      struct __eventStreamTaskParameters__ {
+        httpServer *ths;
+        TcpConnection *connection;
+        int stream;
+        unsigned long lastEventId;
+      };
+
+      static void __eventStreamTask__ (void *taskParameters) { // runs event stream that reactor has released
+        __eventStreamTaskParameters__ *p = (__eventStreamTaskParameters__ *) taskParameters;
+        p->ths->__runEventStream__ (p->connection, p->stream, p->lastEventId);
+        delete (p->connection);
+        delete (p);
+        vTaskDelete (NULL);
+      }
+
+      void __runWebSocket__ (TcpConnection *connection, String& wsRequest) {
+        WebSocket *webSocket = new WebSocket (connection, wsRequest); 
+        if (webSocket && webSocket->isOpened ()) { // check success
+          if (__externalWsRequestHandler__) __externalWsRequestHandler__ (wsRequest, webSocket);
+          delete (webSocket);
+        } else {
+          webDmesg ("[httpServer] can't open WebSocket.");
+        }
+      }
+
+      struct __webSocketTaskParameters__ {
+        httpServer *ths;
+        TcpConnection *connection;
+        String wsRequest;
+      };
+
+      static void __webSocketTask__ (void *taskParameters) { // runs WebSocket that reactor has released
+        __webSocketTaskParameters__ *p = (__webSocketTaskParameters__ *) taskParameters;
+        p->ths->__runWebSocket__ (p->connection, p->wsRequest);
+        delete (p->connection);
+        delete (p);
+        vTaskDelete (NULL);
+      }
+
+      String __cacheControlDirectory__ [HTTP_SERVER_MAX_CACHE_CONTROL_DIRECTORIES]; // full paths ending with /
+      String __cacheControl__ [HTTP_SERVER_MAX_CACHE_CONTROL_DIRECTORIES];
+      int __cacheControlCount__ = 0;
+
+      #ifdef __FILE_SYSTEM__
+        String __uploadDirectory__ = ""; // full path ending with / or "" if uploads are not allowed
+
+        // access log: producers (connection threads) reserve a record in the ring, fill it outside of critical section and then mark it ready,
+        // the background task writes ready records to file in the order they were reserved
+        struct __accessLogRecord__ {
+          bool ready;                                       // filled and waiting to be written
+          time_t time;                                      // GMT or 0 if the time is not set
+          char clientIP [16];
+          char method [8];
+          char path [64];                                   // longer paths are truncated
+          uint16_t status;
+          unsigned long bytesSent;
+          unsigned long durationMicros;
+        };
+        portMUX_TYPE __csAccessLog__ = portMUX_INITIALIZER_UNLOCKED;
+        __accessLogRecord__ *__accessLog__ = NULL;          // HTTP_SERVER_ACCESS_LOG_RING_SIZE records, allocated by startAccessLog
+        unsigned long __accessLogHead__ = 0;                // the next record to be reserved
+        unsigned long __accessLogTail__ = 0;                // the next record to be written to file
+        unsigned long __accessLogRecords__ = 0;             // written to file
+        unsigned long __accessLogDropped__ = 0;             // because the ring was full
+        unsigned long __accessLogReportedDropped__ = 0;     // already reported in the file
+        String __accessLogFileName__;
+        size_t __accessLogMaxFileSize__;
+        bool __accessLogRunning__ = false;
+        bool __accessLogFinished__ = false;
+
+        void __logRequest__ (wwwSessionParameters *wsp, int status, unsigned long bytesSent, unsigned long durationMicros) {
+          if (!__accessLog__) return;
+          __accessLogRecord__ *r = NULL;
+          portENTER_CRITICAL (&__csAccessLog__);
+            if (__accessLogHead__ - __accessLogTail__ < HTTP_SERVER_ACCESS_LOG_RING_SIZE) r = &__accessLog__ [__accessLogHead__ ++ % HTTP_SERVER_ACCESS_LOG_RING_SIZE];
+            else __accessLogDropped__ ++;
+          portEXIT_CRITICAL (&__csAccessLog__);
+          if (!r) return;
+          r->time = getGmt ();
+          strncpy (r->clientIP, wsp->connection->getOtherSideIP (), sizeof (r->clientIP) - 1); r->clientIP [sizeof (r->clientIP) - 1] = 0;
+          httpField f = wsp->getHttpRequestMethod ();
+          int l = f.length < (int) sizeof (r->method) - 1 ? f.length : sizeof (r->method) - 1; memcpy (r->method, f.value, l); r->method [l] = 0;
+          f = wsp->getHttpRequestPath ();
+          l = f.length < (int) sizeof (r->path) - 1 ? f.length : sizeof (r->path) - 1; memcpy (r->path, f.value, l); r->path [l] = 0;
+          r->status = status;
+          r->bytesSent = bytesSent;
+          r->durationMicros = durationMicros;
+          portENTER_CRITICAL (&__csAccessLog__);
+            r->ready = true;
+          portEXIT_CRITICAL (&__csAccessLog__);
+        }
+
+        static void __accessLogTask__ (void *taskParameters) { // writes access log records to file in the background
+          httpServer *ths = (httpServer *) taskParameters;
+          char *block = (char *) malloc (HTTP_SERVER_FILE_BLOCK_SIZE);
+          if (!block) webDmesg ("[httpServer] can't get heap memory for access log block, access log records will be dropped.");
+          unsigned long lastFlushMillis = millis ();
+          while (true) {
+            bool running = ths->__accessLogRunning__;
+            portENTER_CRITICAL (&ths->__csAccessLog__);
+              unsigned long waiting = ths->__accessLogHead__ - ths->__accessLogTail__;
+            portEXIT_CRITICAL (&ths->__csAccessLog__);
+            if (!running || waiting >= HTTP_SERVER_ACCESS_LOG_RING_SIZE / 2 || (waiting && millis () - lastFlushMillis >= HTTP_SERVER_ACCESS_LOG_FLUSH_INTERVAL)) {
+              ths->__flushAccessLog__ (block);
+              lastFlushMillis = millis ();
+            }
+            if (!running) break;
+            delay (100);
+          }
+          if (block) free (block);
+          ths->__accessLogFinished__ = true;
+          vTaskDelete (NULL);
+        }
+
+        void __flushAccessLog__ (char *block) { // appends all ready records to the file, HTTP_SERVER_FILE_BLOCK_SIZE bytes at a time
+          File f;
+          size_t blockLength = 0;
+          unsigned long dropped = 0;
+          while (true) {
+            __accessLogRecord__ r;
+            portENTER_CRITICAL (&__csAccessLog__);
+              bool ready = __accessLogTail__ != __accessLogHead__ && __accessLog__ [__accessLogTail__ % HTTP_SERVER_ACCESS_LOG_RING_SIZE].ready;
+              if (ready) {
+                r = __accessLog__ [__accessLogTail__ % HTTP_SERVER_ACCESS_LOG_RING_SIZE];
+                __accessLog__ [__accessLogTail__ ++ % HTTP_SERVER_ACCESS_LOG_RING_SIZE].ready = false; // the record may be reused
+              }
+              if (!ready) { dropped = __accessLogDropped__ - __accessLogReportedDropped__; __accessLogReportedDropped__ = __accessLogDropped__; }
+            portEXIT_CRITICAL (&__csAccessLog__);
+            char line [160];
+            int lineLength = 0;
+            if (ready) {
+              char t [20] = "-";
+              if (r.time) { struct tm st = timeToStructTime (r.time); strftime (t, sizeof (t), "%Y/%m/%d %H:%M:%S", &st); }
+              lineLength = sprintf (line, "%s %s %s %s %u %lu %lu\n", t, r.clientIP, r.method, r.path, r.status, r.bytesSent, r.durationMicros);
+            } else if (dropped) {
+              lineLength = sprintf (line, "# %lu records dropped\n", dropped); // the ring was full
+            }
+            if (block && (blockLength + lineLength > HTTP_SERVER_FILE_BLOCK_SIZE || (!lineLength && blockLength))) { // write the block when it is full or when there is nothing more to add
+              if (!f) f = FFat.open (__accessLogFileName__, FILE_APPEND);
+              if (!f || f.write ((uint8_t *) block, blockLength) != blockLength) { webDmesg ("[httpServer] can't write " + __accessLogFileName__); if (f) f.close (); return; }
+              blockLength = 0;
+            }
+            if (!lineLength) break;
+            if (block) { memcpy (block + blockLength, line, lineLength); blockLength += lineLength; if (ready) __accessLogRecords__ ++; }
+          }
+          if (!f) return;
+          size_t size = f.position (); // appending, so this is the size of the file
+          f.close ();
+          if (size > __accessLogMaxFileSize__) { // rotate
+            String old = __accessLogFileName__ + ".1";
+            FFat.remove (old);
+            FFat.rename (__accessLogFileName__, old);
+          }
+        }
+
+        String __accessLogStatistics__ () {
+          if (!__accessLog__) return "";
+          portENTER_CRITICAL (&__csAccessLog__);
+            String s = ",\"accessLog\":{\"records\":" + String (__accessLogRecords__) + ",\"dropped\":" + String (__accessLogDropped__) + "}";
+          portEXIT_CRITICAL (&__csAccessLog__);
+          return s;
+        }
+
+        String __receiveFile__ (String& fileName, httpServer::wwwSessionParameters *wsp) { // writes PUT request body into fileName, block by block as it arrives
+          if (__uploadDirectory__ == "" || !fileName.startsWith (__uploadDirectory__)) return "HTTP/1.1 405 Method not allowed\r\nAllow:GET, HEAD\r\nContent-Length:0\r\n\r\n";
+          if (fileName.endsWith ("/") || fileName.indexOf ("/.") >= 0 || fileName.indexOf ("//") >= 0 || isDirectory (fileName)) return "HTTP/1.1 400 Bad request\r\nContent-Length:25\r\n\r\nError: invalid file name.";
+
+          char *block = (char *) malloc (HTTP_SERVER_FILE_BLOCK_SIZE);
+          if (!block) return "HTTP/1.1 503 Service unavailable\r\nContent-Length:25\r\n\r\nError: not enough memory.";
+          bool fileExisted = FFat.exists (fileName);
+          String partFileName = fileName + ".part"; // the body is written aside first, so a failed upload leaves the existing file as it was
+          File f = FFat.open (partFileName, FILE_WRITE);
+          if (!f) {
+            free (block);
+            webDmesg ("[httpServer] could not open " + partFileName + " for writing.");
+            return "HTTP/1.1 409 Conflict\r\nContent-Length:39\r\n\r\nError: could not open file for writing.";
+          }
+          // collect whole blocks (FAT clusters) before writing them to flash, the body is received directly into the block whenever possible
+          int blockLength = 0;
+          int received;
+          bool written = true;
+          while ((received = wsp->readHttpRequestBody (block + blockLength, HTTP_SERVER_FILE_BLOCK_SIZE - blockLength)) > 0)
+            if ((blockLength += received) == HTTP_SERVER_FILE_BLOCK_SIZE) {
+              if (!(written = f.write ((uint8_t *) block, blockLength) == (size_t) blockLength)) break;
+              blockLength = 0;
+            }
+          if (written && blockLength) written = f.write ((uint8_t *) block, blockLength) == (size_t) blockLength;
+          f.close ();
+          free (block);
+          if (received < 0 || !written) { // don't leave incomplete file behind
+            webDmesg ("[httpServer] could not receive " + fileName + ".");
+            FFat.remove (partFileName);
+            if (!written) return "HTTP/1.1 507 Insufficient storage\r\nContent-Length:28\r\n\r\nError: could not write file.";
+            return "HTTP/1.1 400 Bad request\r\nContent-Length:30\r\n\r\nError: could not receive file.";
+          }
+          if (!__replaceFile__ (partFileName, fileName)) return "HTTP/1.1 500 Internal server error\r\nContent-Length:29\r\n\r\nError: could not rename file.";
+          if (fileExisted) return "HTTP/1.1 204 No content\r\n\r\n"; // 204 reply never has a body
+          return "HTTP/1.1 201 Created\r\nContent-Length:0\r\n\r\n";
+        }
+
+        static bool __replaceFile__ (String& partFileName, String& fileName) { // moves completely received partFileName over fileName, returns success
+          if (FFat.exists (fileName)) FFat.remove (fileName); // FAT rename doesn't replace existing files
+          if (!FFat.rename (partFileName, fileName)) {
+            webDmesg ("[httpServer] could not rename " + partFileName + " to " + fileName + ".");
+            FFat.remove (partFileName);
+            fileChanged (fileName);
+            return false;
+          }
+          fileChanged (fileName);
+          return true;
+        }
+
+        struct __receiveFilesParameters__ {
+          String directory;                         // full path ending with /
+          File f;
+          String fileName;
+          String partFileName;                      // fileName is written here until the part has been received completely
+          int filesReceived;
+          bool writeError;
+        };
+
+        static bool __receiveFilesSink__ (MULTIPART_EVENT_TYPE event, httpMultipartPart *part, const char *data, int dataLength, void *param) { // writes file parts of multipart/form-data body into directory
+          __receiveFilesParameters__ *p = (__receiveFilesParameters__ *) param;
+          switch (event) {
+            case MULTIPART_PART_BEGIN:  {
+                                          p->fileName = "";
+                                          int i = part->fileName.lastIndexOf ('/'); if (part->fileName.lastIndexOf ('\\') > i) i = part->fileName.lastIndexOf ('\\'); // some browsers send the whole path
+                                          String name = part->fileName.substring (i + 1);
+                                          if (name == "" || name.startsWith (".")) return true; // not a file (or a file that is not welcome), skip it
+                                          p->fileName = p->directory + name;
+                                          p->partFileName = p->fileName + ".part"; // written aside first, so a failed upload leaves the existing file as it was
+                                          if (!(p->f = FFat.open (p->partFileName, FILE_WRITE))) { webDmesg ("[httpServer] could not open " + p->partFileName + " for writing."); p->fileName = ""; p->writeError = true; return false; }
+                                          return true;
+                                        }
+            case MULTIPART_PART_DATA:   if (p->fileName == "") return true;
+                                        if (p->f.write ((uint8_t *) data, dataLength) == (size_t) dataLength) return true;
+                                        p->writeError = true;
+                                        return false;
+            case MULTIPART_PART_END:    if (p->fileName == "") return true;
+                                        p->f.close ();
+                                        if (!__replaceFile__ (p->partFileName, p->fileName)) { p->writeError = true; return false; }
+                                        p->filesReceived ++;
+                                        return true;
+            default:                    if (p->fileName == "") return true; // MULTIPART_PART_FAILED
+                                        p->f.close ();
+                                        FFat.remove (p->partFileName); // don't leave incomplete file behind
+                                        return true;
+          }
+        }
+
+        String __receiveFiles__ (String& directory, httpServer::wwwSessionParameters *wsp) { // writes files uploaded with HTML form (multipart/form-data POST request) into directory
+          if (!directory.endsWith ("/")) directory += "/";
+          if (__uploadDirectory__ == "" || !directory.startsWith (__uploadDirectory__)) return "HTTP/1.1 405 Method not allowed\r\nAllow:GET, HEAD\r\nContent-Length:0\r\n\r\n";
+          if (directory.indexOf ("/.") >= 0 || directory.indexOf ("//") >= 0 || !isDirectory (directory.substring (0, directory.length () - 1))) return "HTTP/1.1 400 Bad request\r\nContent-Length:25\r\n\r\nError: invalid directory.";
+          __receiveFilesParameters__ p = {directory, File (), "", "", 0, false};
+          bool success = wsp->readMultipartHttpRequestBody (__receiveFilesSink__, &p);
+          if (p.writeError) return "HTTP/1.1 507 Insufficient storage\r\nContent-Length:28\r\n\r\nError: could not write file.";
+          if (!success) return "HTTP/1.1 400 Bad request\r\nContent-Length:31\r\n\r\nError: could not receive files.";
+          String s = String (p.filesReceived) + " file(s) uploaded.";
+          return "HTTP/1.1 200 OK\r\nContent-Length:" + String (s.length ()) + "\r\n\r\n" + s;
+        }
+      #endif
+
+      void __validators__ (const char *fileName, size_t size, time_t lastWrite, char *eTag, char *lastModified) { // eTag needs 32 bytes, lastModified 40 bytes (it is left empty if the time of last write is not known)
+        *lastModified = 0;
+        if (lastWrite > 1604962085) { // if the time is > then the time this code was written then the clock must have been set when the file was written
+          sprintf (eTag, "\"%x-%lx\"", (unsigned int) size, (unsigned long) lastWrite); // changes whenever the file gets rewritten
+          struct tm st = timeToStructTime (lastWrite); strftime (lastModified, 40, "%a, %d %b %Y %H:%M:%S GMT", &st);
+        } else { // the file may be rewritten with the same size and the same (wrong) time of last write, count the writes instead
+          portENTER_CRITICAL (&__csFileWrites__);
+            unsigned int writes = __fileWrites__ [__fileNameHash__ (fileName) & (__HTTP_FILE_WRITE_COUNTERS__ - 1)];
+          portEXIT_CRITICAL (&__csFileWrites__);
+          sprintf (eTag, "\"%x-%x-%x\"", (unsigned int) size, (unsigned int) __fileWritesEpoch__, writes);
+        }
+      }
+
+      void __setCacheControl__ (httpServer::wwwSessionParameters *wsp, const char *fileName) { // sets Cache-Control response header field of the deepest directory that fileName is in, if any
+        int deepest = -1;
+        for (int i = 0; i < __cacheControlCount__; i++) 
+          if (!strncmp (fileName, __cacheControlDirectory__ [i].c_str (), __cacheControlDirectory__ [i].length ()) && (deepest < 0 || __cacheControlDirectory__ [i].length () > __cacheControlDirectory__ [deepest].length ())) deepest = i;
+        if (deepest >= 0) wsp->httpResponseHeaderFields += "Cache-Control:" + __cacheControl__ [deepest] + "\r\n";
+      }
+
+      bool __setValidators__ (httpServer::wwwSessionParameters *wsp, const char *fileName, size_t size, time_t lastWrite) { // sets ETag, Last-Modified and Cache-Control response header fields, returns true if the client already has this version of the file
+        char eTag [32];
+        char lastModified [40];
+        __validators__ (fileName, size, lastWrite, eTag, lastModified);
+        wsp->httpResponseHeaderFields += "ETag:" + String (eTag) + "\r\n";
+        if (*lastModified) wsp->httpResponseHeaderFields += "Last-Modified:" + String (lastModified) + "\r\n";
+        __setCacheControl__ (wsp, fileName);
+        if (wsp->httpResponseStatus != "200 OK") return false; // conditional GET only makes sense for 200 replies
+        httpField ifNoneMatch = wsp->findHttpRequestHeaderField ("If-None-Match");
+        if (ifNoneMatch.length) return ifNoneMatch.containsIgnoreCase (eTag) || ifNoneMatch.equals ("*"); // If-None-Match takes precedence over If-Modified-Since
+        return *lastModified && wsp->findHttpRequestHeaderField ("If-Modified-Since").equals (lastModified); // browsers send back exactly what they have got in Last-Modified
+      }
+
+      bool __selectRange__ (httpServer::wwwSessionParameters *wsp, const char *fileName, size_t size, time_t lastWrite, size_t *from, size_t *length) { // handles Range request header field (only a single range is supported): sets the part of the file to be sent, returns false if the range can't be satisfied
+        *from = 0; 
+        *length = size; // by default the whole file is sent
+        wsp->httpResponseHeaderFields += "Accept-Ranges:bytes\r\n";
+        if (wsp->httpResponseStatus != "200 OK") return true;
+        httpField range = wsp->findHttpRequestHeaderField ("Range");
+        if (range.length < 7 || strncasecmp (range.value, "bytes=", 6) || memchr (range.value, ',', range.length)) return true; // multiple ranges are not supported, the client gets the whole file instead
+        httpField ifRange = wsp->findHttpRequestHeaderField ("If-Range");
+        if (ifRange.length) { // send the range only if the file hasn't changed since the client got the first part of it
+          char eTag [32];
+          char lastModified [40];
+          __validators__ (fileName, size, lastWrite, eTag, lastModified);
+          if (!ifRange.equals (eTag) && !(*lastModified && ifRange.equals (lastModified))) return true;
+        }
+        // parse first-last, first- or -suffixLength
+        unsigned long first = 0, last = 0;
+        bool firstGiven = false, lastGiven = false, dash = false;
+        for (int i = 6; i < range.length; i++) {
+          char c = range.value [i];
+          if (c >= '0' && c <= '9') { 
+            if (dash) { last = last * 10 + c - '0'; lastGiven = true; } else { first = first * 10 + c - '0'; firstGiven = true; } 
+          } else if (c == '-' && !dash) { 
+            dash = true; 
+          } else if (c != ' ') {
+            return true; // invalid Range is ignored
+          }
+        }
+        if (!dash || (!firstGiven && !lastGiven) || (firstGiven && lastGiven && last < first)) return true; // invalid Range is ignored
+        if (!firstGiven) { // the last suffixLength bytes
+          if (!last) return false;
+          if (last > size) last = size;
+          *from = size - last;
+          *length = last;
+        } else {
+          if (first >= size) return false;
+          if (!lastGiven || last >= size) last = size - 1;
+          *from = first;
+          *length = last - first + 1;
+        }
+        wsp->httpResponseStatus = "206 Partial content";
+        wsp->httpResponseHeaderFields += "Content-Range:bytes " + String ((unsigned long) *from) + "-" + String ((unsigned long) (*from + *length - 1)) + "/" + String ((unsigned long) size) + "\r\n";
+        return true;
+      }
+
+      String __rangeNotSatisfiable__ (size_t size) {
+        return "HTTP/1.1 416 Range not satisfiable\r\nContent-Range:bytes */" + String ((unsigned long) size) + "\r\nContent-Length:0\r\n\r\n";
+      }
+
+      String __notModified__ (httpServer::wwwSessionParameters *wsp) {
+        return "HTTP/1.1 304 Not modified\r\n" + wsp->httpResponseHeaderFields + "\r\n"; // 304 reply never has a body
+      }
+
+      void __setGzipEncoding__ (httpServer::wwwSessionParameters *wsp) {
+        wsp->httpResponseHeaderFields += "Content-Encoding:gzip\r\n";
+        __setVary__ (wsp);
+      }
+
+      void __setVary__ (httpServer::wwwSessionParameters *wsp) { // for all replies to URL that has gzip encoded variant: prevents proxies from passing gzip encoded content to clients that don't accept it and identity content to those that do
+        if (wsp->httpResponseHeaderFields.indexOf ("Vary:") < 0) wsp->httpResponseHeaderFields += "Vary:Accept-Encoding\r\n";
+      }
+
+      bool __acceptsGzip__ (httpServer::wwwSessionParameters *wsp) { // parses Accept-Encoding token list: gzip (or x-gzip) is accepted unless its q-value is 0, * stands for the codings not listed
+        httpField acceptEncoding = wsp->findHttpRequestHeaderField ("Accept-Encoding");
+        int gzip = -1, any = -1; // -1 = not listed, 0 = refused (q=0), 1 = accepted
+        const char *p = acceptEncoding.value, *e = acceptEncoding.value + acceptEncoding.length;
+        while (p < e) {
+          while (p < e && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+          const char *token = p;
+          while (p < e && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') p++;
+          int tokenLength = p - token;
+          const char *end = p;
+          while (end < e && *end != ',') end++;
+          bool accepted = true; // q-value is 1 if not given
+          for (const char *q = p; q + 1 < end; q++) if ((*q == 'q' || *q == 'Q') && q [1] == '=') { // q is the only parameter codings have
+            accepted = false; // unless there is a non-zero digit
+            for (q += 2; q < end && ((*q >= '0' && *q <= '9') || *q == '.'); q++) if (*q >= '1' && *q <= '9') accepted = true;
+            break;
+          }
+          if ((tokenLength == 4 && !strncasecmp (token, "gzip", 4)) || (tokenLength == 6 && !strncasecmp (token, "x-gzip", 6))) gzip = accepted;
+          else if (tokenLength == 1 && *token == '*') any = accepted;
+          p = end;
+        }
+        return gzip >= 0 ? gzip : any > 0;
+      }
+
+      #ifdef __EMBEDDED_HTML__
+        String __sendEmbeddedFile__ (const embeddedHtmlFile *e, httpServer::wwwSessionParameters *wsp) { // the body goes to lwIP straight from flash, the file system is not involved at all
+          if (e->gzipped) __setGzipEncoding__ (wsp);
+          wsp->httpResponseHeaderFields += "Content-Type:" + String (e->contentType) + "\r\nETag:" + String (e->eTag) + "\r\n";
+          __setCacheControl__ (wsp, (__webServerHomeDirectory__ + e->fileName).c_str ());
+          if (wsp->httpResponseStatus == "200 OK") {
+            httpField ifNoneMatch = wsp->findHttpRequestHeaderField ("If-None-Match");
+            if (ifNoneMatch.containsIgnoreCase (e->eTag) || ifNoneMatch.equals ("*")) return __notModified__ (wsp);
+          }
+          String httpHeader = "HTTP/1.1 " + wsp->httpResponseStatus + "\r\n" + wsp->httpResponseHeaderFields + "Content-Length:" + String ((unsigned long) e->size) + "\r\n\r\n";
+          struct iovec httpResponse [2] = {{(char *) httpHeader.c_str (), httpHeader.length ()}, {(char *) e->body, e->size}};
+          wsp->connection->sendData (httpResponse, wsp->getHttpRequestMethod ().equals ("HEAD") ? 1 : 2); // HEAD reply only has the header
+          return ""; // already sent
+        }
+      #endif
+
       String __internalHttpRequestHandler__ (String& httpRequest, httpServer::wwwSessionParameters *wsp) { 
         // check if HTTP request is file name or report error 404
 
+        #ifdef __EMBEDDED_HTML__
+          // files embedded into the firmware by embed_html.py are looked up first, the client that doesn't accept gzip encoding gets the file from FFat instead
+          httpField embeddedPath = wsp->getHttpRequestPath ();
+          if (embeddedPath.length && *embeddedPath.value == '/' && (wsp->getHttpRequestMethod ().equals ("GET") || wsp->getHttpRequestMethod ().equals ("HEAD"))) {
+            const embeddedHtmlFile *e = embeddedPath.length == 1 ? findEmbeddedHtmlFile ("index.html", 10) : findEmbeddedHtmlFile (embeddedPath.value + 1, embeddedPath.length - 1);
+            if (e && (!e->gzipped || __acceptsGzip__ (wsp))) return __sendEmbeddedFile__ (e, wsp);
+            if (e) __setVary__ (wsp); // the file from FFat is identity variant of gzip encoded embedded file
+          }
+        #endif
+
         #ifdef __FILE_SYSTEM__
           if (__fileSystemMounted__) {
 
-            int i = httpRequest.indexOf (' ', 4);
-            if (i >= 0) {
-              String fileName = httpRequest.substring (5, i);
+            httpField path = wsp->getHttpRequestPath ();
+            if (path.length && *path.value == '/') {
+              String fileName = path.toString ().substring (1); // query is not a part of file name
+              if (wsp->getHttpRequestMethod ().equals ("PUT")) { fileName = __webServerHomeDirectory__ + fileName; return __receiveFile__ (fileName, wsp); }
+              if (wsp->getHttpRequestMethod ().equals ("POST") && wsp->findHttpRequestHeaderField ("Content-Type").containsIgnoreCase ("multipart/form-data")) { fileName = __webServerHomeDirectory__ + fileName; return __receiveFiles__ (fileName, wsp); }
               if (fileName == "") fileName = "index.html";
               fileName = __webServerHomeDirectory__ + fileName;
 
-              File f = FFat.open (fileName.c_str (), FILE_READ);           
+              // if precompressed fileName.gz exists and the client accepts gzip encoding send fileName.gz instead
+              bool gzipAccepted = !fileName.endsWith (".gz") && __acceptsGzip__ (wsp);
+              String gzipFileName = fileName + ".gz";
+
+              #if HTTP_SERVER_FILE_CACHE_SIZE > 0
+                unsigned long fileCacheChanges;
+                __cachedFile__ *cachedFile;
+                if (gzipAccepted && (cachedFile = __getCachedFile__ (gzipFileName.c_str (), &fileCacheChanges, false))) __setGzipEncoding__ (wsp);
+                else if ((cachedFile = __getCachedFile__ (fileName.c_str (), &fileCacheChanges)) && cachedFile->gzipVariant) {
+                  if (gzipAccepted) { __releaseCachedFile__ (cachedFile); cachedFile = NULL; } // fileName.gz is not in the cache (yet), read it from FFat below
+                  else __setVary__ (wsp);
+                }
+                if (cachedFile) {
+                  size_t from, length;
+                  if (__setValidators__ (wsp, cachedFile->fileName (), cachedFile->size, cachedFile->lastWrite)) { __releaseCachedFile__ (cachedFile); return __notModified__ (wsp); }
+                  if (!__selectRange__ (wsp, cachedFile->fileName (), cachedFile->size, cachedFile->lastWrite, &from, &length)) { size_t size = cachedFile->size; __releaseCachedFile__ (cachedFile); return __rangeNotSatisfiable__ (size); }
+                  return __sendCachedFile__ (cachedFile, wsp, from, length);
+                }
+              #endif
+
+              File f;
+              bool gzipVariant = false; // of the file that is sent without gzip encoding
+              if (gzipAccepted && (f = FFat.open (gzipFileName.c_str (), FILE_READ)) && !f.isDirectory ()) {
+                fileName = gzipFileName;
+                __setGzipEncoding__ (wsp);
+              } else {
+                if (f) f.close ();
+                if (!gzipAccepted && !fileName.endsWith (".gz") && FFat.exists (gzipFileName.c_str ())) { gzipVariant = true; __setVary__ (wsp); } // if the client accepted gzip we already know there is no fileName.gz
+                f = FFat.open (fileName.c_str (), FILE_READ);
+              }
               if (f) {
                 if (!f.isDirectory ()) {
-                  char *buff = (char *) malloc (2048); // get 2 KB of memory from heap
-                  if (buff) {
-                    String httpHeader = "HTTP/1.1 " + wsp->httpResponseStatus + "\r\n" + wsp->httpResponseHeaderFields + "Content-Length:" + String (f.size ()) + "\r\n\r\n";
-                    if (httpHeader.length () > 2046) { // there should normally be enough space, but check anyway
+                  size_t size = f.size ();
+                  time_t lastWrite = f.getLastWrite ();
+                  if (__setValidators__ (wsp, fileName.c_str (), size, lastWrite)) { f.close (); return __notModified__ (wsp); } // the file body doesn't even get read
+                  size_t from, length;
+                  if (!__selectRange__ (wsp, fileName.c_str (), size, lastWrite, &from, &length)) { f.close (); return __rangeNotSatisfiable__ (size); }
+                  #if HTTP_SERVER_FILE_CACHE_SIZE > 0
+                    if (size <= HTTP_SERVER_FILE_CACHE_MAX_FILE_SIZE && fileName.indexOf ("//") < 0 && fileName.indexOf ("/.") < 0 && (cachedFile = __cacheFile__ (fileName.c_str (), f, fileCacheChanges, gzipVariant))) { // only plain paths get cached, __fileChanged__ wouldn't recognize other spellings of the same file
                       f.close ();
-                      return "HTTP/1.1 500 Internal server error\r\nContent-Length:29\r\n\r\nError: HTTP header too large."; 
-                    }
-                    strcpy (buff, httpHeader.c_str ());
-                    int i = strlen (buff);
-                    while (f.available ()) {
-                      *(buff + i++) = f.read ();
-                      if (i == 2048) { wsp->connection->sendData ((char *) buff, 2048); i = 0; }
+                      return __sendCachedFile__ (cachedFile, wsp, from, length);
                     }
-                    if (i) { wsp->connection->sendData (buff, i); }
-                    free (buff);
-                  } 
+                  #endif
+                  if (wsp->getHttpRequestMethod ().equals ("HEAD")) { // HEAD reply only has the header, the file body doesn't need to be read
+                    f.close ();
+                    wsp->connection->sendData ("HTTP/1.1 " + wsp->httpResponseStatus + "\r\n" + wsp->httpResponseHeaderFields + "Content-Length:" + String ((unsigned long) length) + "\r\n\r\n");
+                    return ""; // already sent
+                  }
+                  if (from) f.seek (from);
+                  // read the file in FAT cluster sized blocks into two buffers: while lwIP is transmitting one block the next one is already being read from flash
+                  char *block [2] = {(char *) malloc (HTTP_SERVER_FILE_BLOCK_SIZE), (char *) malloc (HTTP_SERVER_FILE_BLOCK_SIZE)};
+                  if (!block [0] || !block [1]) {
+                    if (block [0]) free (block [0]);
+                    if (block [1]) free (block [1]);
+                    f.close ();
+                    webDmesg ("[httpServer] can't get heap memory for file blocks.");
+                    return "HTTP/1.1 503 Service unavailable\r\nContent-Length:25\r\n\r\nError: not enough memory.";
+                  }
+                  String httpHeader = "HTTP/1.1 " + wsp->httpResponseStatus + "\r\n" + wsp->httpResponseHeaderFields + "Content-Length:" + String ((unsigned long) length) + "\r\n\r\n";
+                  size_t blockLength = f.read ((uint8_t *) block [0], length < HTTP_SERVER_FILE_BLOCK_SIZE ? length : HTTP_SERVER_FILE_BLOCK_SIZE);
+                  length -= blockLength; // what is left to be read
+                  struct iovec segment [2] = {{(char *) httpHeader.c_str (), httpHeader.length ()}, {block [0], blockLength}}; // header goes out together with the first block
+                  bool sendFailed = false;
+                  for (int b = 0; segment [0].iov_len || segment [1].iov_len; b ^= 1) {
+                    size_t toSend = segment [0].iov_len + segment [1].iov_len;
+                    int sent = wsp->connection->trySendData (segment, 2); // pass to lwIP whatever fits into TCP send buffer right away
+                    if (sent < 0) { sendFailed = true; break; }
+                    size_t nextBlockLength = length ? f.read ((uint8_t *) block [b ^ 1], length < HTTP_SERVER_FILE_BLOCK_SIZE ? length : HTTP_SERVER_FILE_BLOCK_SIZE) : 0; // read the next block while lwIP is transmitting this one
+                    length -= nextBlockLength;
+                    if ((size_t) sent < toSend && wsp->connection->sendData (segment, 2) < (int) (toSend - sent)) { sendFailed = true; break; } // wait until the rest of this block is passed to lwIP
+                    segment [0].iov_len = 0;
+                    segment [1] = {block [b ^ 1], nextBlockLength};
+                  }
+                  free (block [0]);
+                  free (block [1]);
                   f.close ();
+                  if (sendFailed || length) { // the file got shorter (or couldn't be read) after Content-Length has already been sent, the client would wait for the missing bytes or take the next reply for them
+                    if (length) webDmesg ("[httpServer] couldn't read " + fileName + ", closing connection.");
+                    wsp->connection->closeConnection ();
+                  }
                   return ""; // success
                 } // if file is a file, not a directory
                 f.close ();